@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+#include "analyze.hpp"
+#include "log.hpp"
+
+// Number of rows looked at, evenly spread over the image
+#define SAMPLE_ROWS 64
+// Every Nth pixel of a sampled row goes into the distinct color estimate
+#define COLOR_SAMPLE_STEP 4
+// Bits in the linear counting bitmap used to estimate distinct colors
+#define COLOR_BITMAP_BITS (1 << 16)
+// Luma difference that counts as an edge
+#define EDGE_THRESHOLD 32
+
+// Thresholds that separate UI-like from photo-like content
+#define UI_MIN_FLAT_RATIO 0.35f
+#define UI_MAX_UNIQUE_COLORS 4096.0f
+#define UI_MIN_EDGE_DENSITY 0.15f
+
+static inline uint32_t HashColor(uint32_t color) {
+    color ^= color >> 16;
+    color *= 0x7feb352d;
+    color ^= color >> 15;
+    color *= 0x846ca68b;
+    color ^= color >> 16;
+    return color;
+}
+
+ContentStats AnalyzeContent(const Image *image) {
+    auto start = std::chrono::steady_clock::now();
+
+    const uint32_t w = image->w;
+    const uint32_t rows = std::min<uint32_t>(SAMPLE_ROWS, image->h);
+    std::vector<uint8_t> luma(w);
+    std::vector<uint64_t> color_bitmap(COLOR_BITMAP_BITS / 64, 0);
+    uint64_t pairs = 0, edges = 0, flats = 0;
+
+    for (uint32_t r = 0; r < rows; r++) {
+        const uint32_t y = (uint64_t)r * image->h / rows;
+        const uint32_t *row = (const uint32_t *)(image->data + (size_t)y * w * 4);
+        const uint8_t *bytes = (const uint8_t *)row;
+
+        // Simple loops over plain arrays so the compiler can vectorize them
+        for (uint32_t x = 0; x < w; x++) {
+            luma[x] = (77 * bytes[x * 4] + 150 * bytes[x * 4 + 1] + 29 * bytes[x * 4 + 2]) >> 8;
+        }
+        uint32_t row_edges = 0, row_flats = 0;
+        for (uint32_t x = 0; x + 1 < w; x++) {
+            int diff = luma[x + 1] - luma[x];
+            row_edges += (diff > EDGE_THRESHOLD) | (diff < -EDGE_THRESHOLD);
+            row_flats += row[x + 1] == row[x];
+        }
+        edges += row_edges;
+        flats += row_flats;
+        pairs += w > 0 ? w - 1 : 0;
+
+        for (uint32_t x = 0; x < w; x += COLOR_SAMPLE_STEP) {
+            uint32_t bit = HashColor(row[x]) % COLOR_BITMAP_BITS;
+            color_bitmap[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+
+    // Linear counting: n = -m * ln(empty / m)
+    uint32_t set_bits = 0;
+    for (uint64_t word: color_bitmap) {
+        set_bits += __builtin_popcountll(word);
+    }
+    const float m = COLOR_BITMAP_BITS;
+    const float empty = std::max(m - set_bits, 1.0f);
+
+    ContentStats stats;
+    stats.unique_colors = -m * logf(empty / m);
+    stats.edge_density = pairs > 0 ? (float)edges / pairs : 0.0f;
+    stats.flat_ratio = pairs > 0 ? (float)flats / pairs : 1.0f;
+    // UI has large areas of exactly one color and a small palette,
+    // dense text over a noisy background still has far more hard edges than a photo
+    stats.is_ui = stats.flat_ratio >= UI_MIN_FLAT_RATIO
+                  || stats.unique_colors <= UI_MAX_UNIQUE_COLORS
+                  || stats.edge_density >= UI_MIN_EDGE_DENSITY;
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    LogPrint(INFO, "Analyze: ~%.0f colors, %.1f%% edges, %.1f%% flat, looks like %s (%.2f ms)",
+             stats.unique_colors, stats.edge_density * 100, stats.flat_ratio * 100,
+             stats.is_ui ? "UI" : "a photo", elapsed.count());
+
+    return stats;
+}
+
+Format ChooseAutoFormat(const Image *image, EncodeParams *params) {
+    ContentStats stats = AnalyzeContent(image);
+
+    // Lossless for UI so text stays sharp, lossy for photos where it is much smaller
+    if (stats.is_ui) {
+        if (CheckFormatSupport(Format::PNG)) {
+            return Format::PNG;
+        }
+        if (CheckFormatSupport(Format::JXL)) {
+            if (params->quality == 0) {
+                params->quality = 100;
+            }
+            return Format::JXL;
+        }
+    } else {
+        if (CheckFormatSupport(Format::JXL)) {
+            return Format::JXL;
+        }
+        if (CheckFormatSupport(Format::JPEG)) {
+            return Format::JPEG;
+        }
+    }
+
+    // Nothing preferred is available, use whatever is
+    for (Format format: { Format::PNG, Format::JXL, Format::JPEG }) {
+        if (CheckFormatSupport(format)) {
+            return format;
+        }
+    }
+    return Format::INVALID;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "image.hpp"
+#include "encode.hpp"
+
+struct ContentStats {
+    // Estimated number of distinct colors in the sampled pixels
+    float unique_colors;
+    // Share of neighbouring pixel pairs with a strong luma edge between them
+    float edge_density;
+    // Share of neighbouring pixel pairs with exactly the same color
+    float flat_ratio;
+    // True if the image looks like text/UI rather than a photo
+    bool is_ui;
+};
+
+ContentStats AnalyzeContent(const Image *image);
+
+// Picks a supported output format for image based on its content.
+// May set params->quality if the picked format needs it (e.g. lossless JXL for UI), so
+// params should only be used for the picked format.
+Format ChooseAutoFormat(const Image *image, EncodeParams *params);
@@ -1,6 +1,7 @@
 #ifdef SSEDIT_HAVE_LIBTURBOJPEG
 
 #include <cstdlib>
+#include <algorithm>
 #include <turbojpeg.h>
 
 #include "jpeg.hpp"
@@ -53,17 +54,20 @@ err:
 }
 
 unsigned char *EncodeJPEG(unsigned char *src_data, size_t src_data_size,
-                          uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                          uint32_t src_width, uint32_t src_height,
+                          const EncodeParams *params, size_t *out_size) {
     tjhandle tj_instance = nullptr;
     unsigned char *out_buf = nullptr;
     size_t buf_size = 0;
     const int pixel_format = TJPF_RGBA;
     const int subsampling = TJSAMP_444;
-    const int quality = 50;
+    const int quality = params->quality > 0 ? std::min(params->quality, 100) : 50;
     const int pixel_size = tjPixelSize[pixel_format];
     const int pitch = src_width * pixel_size;
+    const bool fast = params->effort > 0 && params->effort <= 2;
+    const int flags = TJFLAG_NOREALLOC | (fast ? TJFLAG_FASTDCT : 0);
 
-    LogPrint(INFO, "JPEG encoder: using libturbojpeg");
+    LogPrint(INFO, "JPEG encoder: using libturbojpeg, quality %d", quality);
 
     tj_instance = tjInitCompress();
     if (tj_instance == nullptr) {
@@ -75,11 +79,13 @@ unsigned char *EncodeJPEG(unsigned char *src_data, size_t src_data_size,
     out_buf = (unsigned char *)malloc(buf_size);
 
     if (tjCompress(tj_instance, src_data, src_width, pitch, src_height, pixel_size,
-                   out_buf, &buf_size, subsampling, quality, TJFLAG_NOREALLOC) < 0) {
+                   out_buf, &buf_size, subsampling, quality, flags) < 0) {
         LogPrint(ERR, "JPEG encoder: tjCompress() failed: %s", tjGetErrorStr());
         goto err;
     }
 
+    tjDestroy(tj_instance);
+
     *out_size = buf_size;
     return out_buf;
 
@@ -106,7 +112,8 @@ unsigned char *DecodeJPEG(const unsigned char *data, size_t data_size,
 }
 
 unsigned char *EncodeJPEG(unsigned char *src_data, size_t src_data_size,
-                          uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                          uint32_t src_width, uint32_t src_height,
+                          const EncodeParams *params, size_t *out_size) {
     LogPrint(ERR, "JPEG encoder: ssedit was compiled without JPEG support, how did you get here?");
 
     return nullptr;
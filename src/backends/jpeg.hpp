@@ -3,9 +3,12 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "encode.hpp"
+
 unsigned char *DecodeJPEG(const unsigned char *data, size_t data_size,
                           uint32_t *width, uint32_t *height);
 
 unsigned char *EncodeJPEG(unsigned char *src_data, size_t src_data_size,
-                          uint32_t src_width, uint32_t src_height, size_t *out_size);
+                          uint32_t src_width, uint32_t src_height,
+                          const EncodeParams *params, size_t *out_size);
 
@@ -1,5 +1,6 @@
 #ifdef SSEDIT_HAVE_LIBJXL
 
+#include <algorithm>
 #include <jxl/codestream_header.h>
 #include <jxl/color_encoding.h>
 #include <jxl/decode.h>
@@ -114,7 +115,8 @@ err:
 }
 
 unsigned char *EncodeJXL(unsigned char *src_data, size_t src_data_size,
-                         uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                         uint32_t src_width, uint32_t src_height,
+                         const EncodeParams *params, size_t *out_size) {
     JxlEncoderPtr enc = nullptr;
     JxlThreadParallelRunnerPtr runner = nullptr;
     JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
@@ -126,6 +128,7 @@ unsigned char *EncodeJXL(unsigned char *src_data, size_t src_data_size,
     size_t avail_out;
     JxlEncoderStatus process_result;
     unsigned char *next_out;
+    const bool lossless = params->quality >= 100;
 
     enc = JxlEncoderMake(nullptr);
     runner = JxlThreadParallelRunnerMake(nullptr,
@@ -144,7 +147,8 @@ unsigned char *EncodeJXL(unsigned char *src_data, size_t src_data_size,
     basic_info.alpha_bits = 8;
     basic_info.num_color_channels = 3;
     basic_info.num_extra_channels = 1;
-    basic_info.uses_original_profile = JXL_FALSE;
+    // Lossless encoding requires the original color profile to be kept
+    basic_info.uses_original_profile = lossless ? JXL_TRUE : JXL_FALSE;
     if (JxlEncoderSetBasicInfo(enc.get(), &basic_info) != JXL_ENC_SUCCESS) {
         LogPrint(ERR, "JXL encoder: JxlEncoderSetBasicInfo failed");
         goto err;
@@ -162,6 +166,27 @@ unsigned char *EncodeJXL(unsigned char *src_data, size_t src_data_size,
         goto err;
     }
 
+    if (params->effort > 0) {
+        if (JxlEncoderFrameSettingsSetOption(frame_settings, JXL_ENC_FRAME_SETTING_EFFORT,
+                                             std::min(params->effort, 10)) != JXL_ENC_SUCCESS) {
+            LogPrint(ERR, "JXL encoder: setting effort failed");
+            goto err;
+        }
+    }
+
+    if (lossless) {
+        if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) != JXL_ENC_SUCCESS) {
+            LogPrint(ERR, "JXL encoder: JxlEncoderSetFrameLossless failed");
+            goto err;
+        }
+    } else if (params->quality > 0) {
+        float distance = JxlEncoderDistanceFromQuality(params->quality);
+        if (JxlEncoderSetFrameDistance(frame_settings, distance) != JXL_ENC_SUCCESS) {
+            LogPrint(ERR, "JXL encoder: JxlEncoderSetFrameDistance failed");
+            goto err;
+        }
+    }
+
     if (JxlEncoderAddImageFrame(frame_settings, &pixel_format,
                                 src_data, src_data_size) != JXL_ENC_SUCCESS) {
         LogPrint(ERR, "JXL encoder: JxlEncoderAddImageFrame failed");
@@ -215,7 +240,8 @@ unsigned char *DecodeJXL(const unsigned char *data, size_t data_size,
 }
 
 unsigned char *EncodeJXL(unsigned char *src_data, size_t src_data_size,
-                         uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                         uint32_t src_width, uint32_t src_height,
+                         const EncodeParams *params, size_t *out_size) {
     LogPrint(ERR, "JXL encoder: ssedit was compiled without JPEG support, how did you get here?");
 
     return nullptr;
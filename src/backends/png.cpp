@@ -1,5 +1,6 @@
 #ifdef SSEDIT_HAVE_LIBSPNG
 
+#include <algorithm>
 #include <spng.h>
 
 #include "png.hpp"
@@ -60,7 +61,8 @@ err:
 }
 
 unsigned char *EncodePNG(unsigned char *src_data, size_t src_data_size,
-                         uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                         uint32_t src_width, uint32_t src_height,
+                         const EncodeParams *params, size_t *out_size) {
     int ret = 0;
     struct spng_ihdr ihdr;
     unsigned char *out_buf = nullptr;
@@ -93,6 +95,20 @@ unsigned char *EncodePNG(unsigned char *src_data, size_t src_data_size,
         goto err;
     }
 
+    if (params->effort > 0) {
+        // Effort maps onto zlib levels, lowest efforts also skip adaptive filtering
+        ret = spng_set_option(ctx, SPNG_IMG_COMPRESSION_LEVEL, std::min(params->effort, 9));
+        if (ret != 0) {
+            goto err;
+        }
+        if (params->effort <= 2) {
+            ret = spng_set_option(ctx, SPNG_FILTER_CHOICE, SPNG_FILTER_CHOICE_SUB);
+            if (ret != 0) {
+                goto err;
+            }
+        }
+    }
+
     ret = spng_encode_image(ctx, src_data, src_data_size, SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE);
     if (ret != 0) {
         goto err;
@@ -138,7 +154,8 @@ unsigned char *DecodePNG(const unsigned char *data, size_t data_size,
 }
 
 unsigned char *EncodePNG(unsigned char *src_data, size_t src_data_size,
-                          uint32_t src_width, uint32_t src_height, size_t *out_size) {
+                          uint32_t src_width, uint32_t src_height,
+                          const EncodeParams *params, size_t *out_size) {
     LogPrint(ERR, "PNG encoder: ssedit was compiled without PNG support, how did you get here?");
 
     return nullptr;
@@ -0,0 +1,444 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ini.h>
+
+#include "batch.hpp"
+#include "shapes.hpp"
+#include "raster.hpp"
+#include "decode.hpp"
+#include "analyze.hpp"
+#include "threadpool.hpp"
+#include "config.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+
+enum class Section {
+    NONE,
+    OUTPUT,
+    LINE,
+    CIRCLE,
+    RECTANGLE,
+    FREEFORM,
+    ARROW,
+};
+
+// One shape section of the script, added to the store once the whole file is read
+struct ShapeDef {
+    Section kind = Section::NONE;
+    ImVec2 start = ImVec2(0, 0);
+    ImVec2 end = ImVec2(0, 0);
+    float radius = 0.0f;
+    std::vector<ImVec2> points;
+    ImVec4 color = ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
+    float thickness = 4.0f;
+    bool fill = false;
+    bool has_start = false;
+    bool has_end = false;
+};
+
+struct BatchScript {
+    ExportSettings settings;
+    bool crop = false;
+    uint32_t crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0;
+    std::vector<ShapeDef> defs;
+    ShapeStore shapes;
+    Section section = Section::NONE;
+    bool ok = true;
+};
+
+static Section SectionFromString(const char *str) {
+    if (STREQ(str, "output")) {
+        return Section::OUTPUT;
+    } else if (STREQ(str, "line")) {
+        return Section::LINE;
+    } else if (STREQ(str, "circle")) {
+        return Section::CIRCLE;
+    } else if (STREQ(str, "rectangle")) {
+        return Section::RECTANGLE;
+    } else if (STREQ(str, "freeform")) {
+        return Section::FREEFORM;
+    } else if (STREQ(str, "arrow")) {
+        return Section::ARROW;
+    } else {
+        return Section::NONE;
+    }
+}
+
+static const char *SectionToString(Section section) {
+    switch (section) {
+    case Section::OUTPUT:
+        return "output";
+    case Section::LINE:
+        return "line";
+    case Section::CIRCLE:
+        return "circle";
+    case Section::RECTANGLE:
+        return "rectangle";
+    case Section::FREEFORM:
+        return "freeform";
+    case Section::ARROW:
+        return "arrow";
+    default:
+        return "none";
+    }
+}
+
+static ShapeType SectionToShapeType(Section section) {
+    switch (section) {
+    case Section::LINE:
+        return ShapeType::LINE;
+    case Section::CIRCLE:
+        return ShapeType::CIRCLE;
+    case Section::RECTANGLE:
+        return ShapeType::RECTANGLE;
+    case Section::ARROW:
+        return ShapeType::ARROW;
+    default:
+        return ShapeType::FREEFORM;
+    }
+}
+
+static bool ParsePoint(const char *str, ImVec2 *point) {
+    char trailing;
+    return sscanf(str, " %f , %f %c", &point->x, &point->y, &trailing) == 2;
+}
+
+static bool ParseFloat(const char *str, float *f) {
+    char *endptr;
+
+    errno = 0;
+    *f = strtof(str, &endptr);
+    return errno == 0 && endptr != str && *endptr == '\0';
+}
+
+static bool ParseBool(const char *str, bool *b) {
+    if (STREQ(str, "true") || STREQ(str, "yes") || STREQ(str, "1")) {
+        *b = true;
+    } else if (STREQ(str, "false") || STREQ(str, "no") || STREQ(str, "0")) {
+        *b = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool HandleOutputKey(BatchScript *script, const char *name, const char *value) {
+    ExportSettings &settings = script->settings;
+
+    if (STREQ(name, "format")) {
+        settings.format = FormatFromString(value);
+        return settings.format != Format::INVALID;
+    } else if (STREQ(name, "quality")) {
+        settings.params.quality = atoi(value);
+        return settings.params.quality >= 1 && settings.params.quality <= 100;
+    } else if (STREQ(name, "effort")) {
+        settings.params.effort = atoi(value);
+        return settings.params.effort >= 1 && settings.params.effort <= 10;
+    } else if (STREQ(name, "max_bytes")) {
+        return ParseSize(value, &settings.target.max_bytes) && settings.target.max_bytes > 0;
+    } else if (STREQ(name, "min_ssim")) {
+        return ParseFloat(value, &settings.target.min_ssim)
+               && settings.target.min_ssim > 0.0f && settings.target.min_ssim <= 1.0f;
+    } else if (STREQ(name, "crop")) {
+        char trailing;
+        script->crop = true;
+        return sscanf(value, " %u , %u , %u , %u %c", &script->crop_x, &script->crop_y,
+                      &script->crop_w, &script->crop_h, &trailing) == 4
+               && script->crop_w > 0 && script->crop_h > 0;
+    }
+    return false;
+}
+
+static bool HandleShapeKey(ShapeDef *def, const char *name, const char *value) {
+    if (STREQ(name, "start") || STREQ(name, "center")) {
+        def->has_start = ParsePoint(value, &def->start);
+        return def->has_start;
+    } else if (STREQ(name, "end")) {
+        def->has_end = ParsePoint(value, &def->end);
+        return def->has_end;
+    } else if (STREQ(name, "point")) {
+        ImVec2 point;
+        if (!ParsePoint(value, &point)) {
+            return false;
+        }
+        def->points.push_back(point);
+        return true;
+    } else if (STREQ(name, "radius")) {
+        return ParseFloat(value, &def->radius) && def->radius >= 0.0f;
+    } else if (STREQ(name, "color")) {
+        return HexStringToVec(value, &def->color);
+    } else if (STREQ(name, "thickness")) {
+        return ParseFloat(value, &def->thickness) && def->thickness > 0.0f;
+    } else if (STREQ(name, "fill")) {
+        return ParseBool(value, &def->fill);
+    }
+    return false;
+}
+
+static int ScriptHandler(void *data, const char *section, const char *name, const char *value) {
+    BatchScript *script = (BatchScript *)data;
+
+    // inih calls with no name at the start of every section, that's how repeated
+    // sections like two [arrow]s are told apart
+    if (name == nullptr) {
+        script->section = SectionFromString(section);
+        switch (script->section) {
+        case Section::NONE:
+            LogPrint(ERR, "Batch: unknown section [%s]", section);
+            script->ok = false;
+            break;
+        case Section::OUTPUT:
+            break;
+        default:
+            script->defs.emplace_back();
+            script->defs.back().kind = script->section;
+            break;
+        }
+        return 1;
+    }
+
+    bool valid;
+    switch (script->section) {
+    case Section::NONE:
+        valid = false;
+        break;
+    case Section::OUTPUT:
+        valid = HandleOutputKey(script, name, value);
+        break;
+    default:
+        valid = HandleShapeKey(&script->defs.back(), name, value);
+        break;
+    }
+    if (!valid) {
+        LogPrint(ERR, "Batch: invalid %s = %s in section [%s]", name, value, section);
+        script->ok = false;
+    }
+
+    return 1;
+}
+
+// Adds the shape the same way the editor does: begun at the first point,
+// then updated with every following one
+static bool AddShape(ShapeStore *shapes, const ShapeDef &def) {
+    ImU32 color = ImGui::ColorConvertFloat4ToU32(def.color);
+
+    switch (def.kind) {
+    case Section::LINE:
+    case Section::RECTANGLE:
+    case Section::ARROW:
+        if (!def.has_start || !def.has_end) {
+            LogPrint(ERR, "Batch: [%s] needs start and end", SectionToString(def.kind));
+            return false;
+        }
+        shapes->Begin(SectionToShapeType(def.kind), def.start, color, def.thickness, def.fill);
+        shapes->Update(def.end);
+        break;
+    case Section::CIRCLE:
+        if (!def.has_start || def.radius <= 0.0f) {
+            LogPrint(ERR, "Batch: [circle] needs center and radius");
+            return false;
+        }
+        shapes->Begin(ShapeType::CIRCLE, def.start, color, def.thickness, def.fill);
+        shapes->Update(def.start + ImVec2(def.radius, 0));
+        break;
+    case Section::FREEFORM:
+        if (def.points.empty()) {
+            LogPrint(ERR, "Batch: [freeform] needs at least one point");
+            return false;
+        }
+        shapes->Begin(ShapeType::FREEFORM, def.points[0], color, def.thickness, def.fill);
+        // Scripted points are kept as they are, Update() would thin them out like cursor samples
+        for (size_t i = 1; i < def.points.size(); i++) {
+            shapes->AddPoint(def.points[i]);
+        }
+        break;
+    default:
+        return false;
+    }
+
+    shapes->Commit();
+    return true;
+}
+
+static bool LoadBatchScript(const char *path, BatchScript *script) {
+    int rc = ini_parse(path, ScriptHandler, script);
+    if (rc < 0) {
+        LogPrint(ERR, "Batch: failed to open script %s", path);
+        return false;
+    } else if (rc > 0) {
+        LogPrint(ERR, "Batch: syntax error in %s on line %d", path, rc);
+        return false;
+    }
+    if (!script->ok) {
+        return false;
+    }
+
+    for (const ShapeDef &def: script->defs) {
+        if (!AddShape(&script->shapes, def)) {
+            return false;
+        }
+    }
+
+    LogPrint(INFO, "Batch: %zu shapes, output %s", script->shapes.Size(),
+             FormatToString(script->settings.format));
+    return true;
+}
+
+// input.png -> output_dir/input
+static std::string OutputStem(const char *input, const char *output_dir) {
+    const char *slash = strrchr(input, '/');
+    std::string stem = slash != nullptr ? slash + 1 : input;
+    size_t dot = stem.rfind('.');
+    if (dot != std::string::npos && dot > 0) {
+        stem.resize(dot);
+    }
+
+    std::string path = output_dir;
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    return path + stem;
+}
+
+// input.png -> output_dir/input.ext
+static std::string OutputPath(const char *input, const char *output_dir, Format format) {
+    return OutputStem(input, output_dir) + "." + FormatToExtension(format);
+}
+
+// Reads, decodes, annotates, encodes and writes one file. Every stage drops what the
+// previous one produced as soon as it can to keep the footprint of a file in flight small.
+static bool ProcessFile(const BatchScript &script, const char *input, const char *output_dir) {
+    auto start = std::chrono::steady_clock::now();
+    ExportSettings settings = script.settings;
+    std::shared_ptr<const Image> rendered;
+    Image *image = nullptr;
+    Image *encoded = nullptr;
+    unsigned char *raw_data = nullptr;
+    size_t data_size;
+    std::string output_path;
+    bool ok = false;
+    int fd;
+
+    fd = open(input, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LogPrint(ERR, "Batch: failed to open %s (%s)", input, strerror(errno));
+        goto out;
+    }
+    raw_data = ReadFromFD(fd, &data_size);
+    close(fd);
+    if (raw_data == nullptr) {
+        goto out;
+    }
+
+    image = DecodeImage(raw_data, data_size);
+    free(raw_data);
+    if (image == nullptr) {
+        LogPrint(ERR, "Batch: failed to decode %s", input);
+        goto out;
+    }
+
+    if (script.crop) {
+        Image *cropped = CropImage(image, script.crop_x, script.crop_y,
+                                   script.crop_w, script.crop_h);
+        if (cropped == nullptr) {
+            LogPrint(ERR, "Batch: crop %ux%u at %u,%u doesn't fit into %s (%ux%u)",
+                     script.crop_w, script.crop_h, script.crop_x, script.crop_y,
+                     input, image->w, image->h);
+            goto out;
+        }
+        delete image;
+        image = cropped;
+    }
+
+    if (settings.format == Format::AUTO) {
+        settings.format = ChooseAutoFormat(image, &settings.params);
+    }
+
+    rendered = RenderExportCPU(image, script.shapes);
+    delete image;
+    image = nullptr;
+    if (rendered == nullptr) {
+        goto out;
+    }
+
+    encoded = EncodeForExport(rendered.get(), settings);
+    rendered.reset();
+    if (encoded == nullptr) {
+        LogPrint(ERR, "Batch: failed to encode %s", input);
+        goto out;
+    }
+
+    output_path = OutputPath(input, output_dir, settings.format);
+    fd = open(output_path.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
+              S_IWUSR | S_IWGRP | S_IRUSR | S_IRGRP);
+    if (fd < 0) {
+        LogPrint(ERR, "Batch: failed to open %s (%s)", output_path.c_str(), strerror(errno));
+        goto out;
+    }
+    ok = WriteToFD(fd, encoded->data, encoded->data_size);
+    close(fd);
+    if (!ok) {
+        LogPrint(ERR, "Batch: failed to write %s", output_path.c_str());
+        goto out;
+    }
+
+    LogPrint(INFO, "Batch: %s -> %s (%zu bytes, %.0f ms)", input, output_path.c_str(),
+             encoded->data_size, std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start).count());
+
+out:
+    delete image;
+    delete encoded;
+    return ok;
+}
+
+int RunBatch(const char *script_path, const std::vector<const char *> &inputs,
+             const char *output_dir, const ExportSettings &defaults) {
+    auto start = std::chrono::steady_clock::now();
+    BatchScript script;
+    script.settings = defaults;
+
+    if (!LoadBatchScript(script_path, &script)) {
+        return 1;
+    }
+    if (script.settings.format != Format::AUTO && !CheckFormatSupport(script.settings.format)) {
+        LogPrint(ERR, "Batch: %s is not supported by this build",
+                 FormatToString(script.settings.format));
+        return 1;
+    }
+
+    // Inputs from different directories can share a name. The extension isn't known before
+    // auto format picks one, so outputs that differ only in it are refused too.
+    std::unordered_map<std::string, const char *> stems;
+    for (const char *input: inputs) {
+        auto [it, inserted] = stems.emplace(OutputStem(input, output_dir), input);
+        if (!inserted) {
+            LogPrint(ERR, "Batch: %s and %s would both be written to %s.*",
+                     it->second, input, it->first.c_str());
+            return 1;
+        }
+    }
+
+    // Every worker takes the next file and runs it through all stages, so different files
+    // are in different stages at the same time and at most a pool's worth is in memory
+    std::atomic<size_t> failed = 0;
+    ParallelFor(inputs.size(), [&](size_t i) {
+        if (!ProcessFile(script, inputs[i], output_dir)) {
+            failed++;
+        }
+    });
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    LogPrint(INFO, "Batch: %zu of %zu files done in %.2f s",
+             inputs.size() - failed, inputs.size(), elapsed.count());
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+#include "export.hpp"
+
+// Annotates every input with the shapes from script_path and writes the results into
+// output_dir, named after the input with the extension of the output format.
+// Output settings from the script override defaults. Files are processed concurrently,
+// at most one per thread pool thread, so memory use is bounded no matter how many
+// inputs there are. Inputs that would be written to the same name are refused before
+// anything is processed. Returns 0 if every file was written.
+int RunBatch(const char *script_path, const std::vector<const char *> &inputs,
+             const char *output_dir, const ExportSettings &defaults);
@@ -1,6 +1,18 @@
 #pragma once
 
+#include <cstdint>
+
 #include "image.hpp"
 
-bool CopyToClipboard(const Image *image);
+// Returns a serial for a new clipboard offer, making all earlier serials outdated
+uint64_t NewClipboardSerial(void);
+
+bool IsClipboardSerialCurrent(uint64_t serial);
+
+// Offers image on the clipboard, replacing whatever was offered before with the same serial.
+// Does nothing and returns false if a newer serial was handed out since then.
+bool CopyToClipboard(const Image *image, uint64_t serial);
 
+// Collects wl-copy processes that have exited without waiting for the rest, call it regularly.
+// Returns true if some are still running.
+bool ReapClipboardProcesses(void);
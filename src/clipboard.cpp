@@ -1,69 +1,141 @@
+#include <mutex>
 #include <cstring>
 #include <cerrno>
 #include <cstdlib>
 #include <climits>
+#include <vector>
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include "clibpoard.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
+// Protects clipboard_serial and makes sure an outdated offer can't race with a newer one
+static std::mutex clipboard_mutex;
+static uint64_t clipboard_serial = 0;
+
+// wl-copy processes that haven't been waited for yet
+static std::mutex children_mutex;
+static std::vector<pid_t> children;
+
 // This uses wl-copy, not because I'm lazy, but because due to the way wayland
 // works clipboard contents will disappear once ssedit is closed.
 // wl-copy forks itself in the background and clipboard will persist.
-bool CopyToClipboard(const Image *image) {
-    const char *tmpdir;
-    int tmpfile_fd = -1;
-
-    tmpdir = getenv("TMPDIR");
-    if (tmpdir == nullptr) {
-        tmpdir = "/tmp";
-    }
+//
+// Contents are handed over in a sealed memfd so they never touch the disk, and wl-copy is
+// started with posix_spawn which doesn't copy our (potentially huge) page tables like fork does.
+static bool SpawnWlCopy(const Image *image) {
+    int memfd = -1;
+    pid_t pid;
+    int ret;
+    posix_spawn_file_actions_t file_actions;
+    bool file_actions_initialized = false;
+    char *argv[] = {
+        (char *)"wl-copy",
+        (char *)"-t",
+        (char *)FormatToMIME(image->format),
+        nullptr,
+    };
 
-    tmpfile_fd = open(tmpdir, O_RDWR | O_TMPFILE, S_IRUSR | S_IWUSR);
-    if (tmpfile_fd < 0) {
-        LogPrint(ERR, "Clipboard: failed to open temporary file (%s)", strerror(errno));
+    memfd = memfd_create("ssedit-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        LogPrint(ERR, "Clipboard: failed to create memfd (%s)", strerror(errno));
         goto err;
     }
-    if (ftruncate(tmpfile_fd, image->data_size) < 0) {
-        LogPrint(ERR, "Clipboard: failed to truncate temporary file (%s)", strerror(errno));
+    if (ftruncate(memfd, image->data_size) < 0) {
+        LogPrint(ERR, "Clipboard: failed to truncate memfd (%s)", strerror(errno));
         goto err;
     }
 
-    if (!WriteToFD(tmpfile_fd, image->data, image->data_size)) {
-        LogPrint(ERR, "Clipboard: writing clipboard contents to temporary file failed");
+    if (!WriteToFD(memfd, image->data, image->data_size)) {
+        LogPrint(ERR, "Clipboard: writing clipboard contents to memfd failed");
         goto err;
     }
-    if (lseek(tmpfile_fd, 0, SEEK_SET) < 0) {
-        LogPrint(ERR, "Clipboard: failed to rewird tmpfile position (%s)", strerror(errno));
+    // wl-copy only gets to read it
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        LogPrint(WARN, "Clipboard: failed to seal memfd (%s)", strerror(errno));
+    }
+    if (lseek(memfd, 0, SEEK_SET) < 0) {
+        LogPrint(ERR, "Clipboard: failed to rewind memfd position (%s)", strerror(errno));
         goto err;
     };
 
-    pid_t pid;
-    switch (pid = fork()) {
-    case -1: // Error
-        LogPrint(ERR, "Clipboard: failed to fork child (%s)", strerror(errno));
+    // Redirect stdin from memfd, dup2 also clears CLOEXEC on the new descriptor
+    posix_spawn_file_actions_init(&file_actions);
+    file_actions_initialized = true;
+    ret = posix_spawn_file_actions_adddup2(&file_actions, memfd, STDIN_FILENO);
+    if (ret != 0) {
+        LogPrint(ERR, "Clipboard: failed to set up stdin redirect (%s)", strerror(ret));
         goto err;
-    case 0: // Child
-        // Redirect stdin from temporary file
-        if (dup2(tmpfile_fd, 0) < 0) {
-            LogPrint(ERR, "Clipboard: failed to redirect stdin (%s)", strerror(errno));
-            exit(69);
-        }
-        execlp("wl-copy", "wl-copy", "-t", FormatToMIME(image->format), nullptr);
-        LogPrint(ERR, "Clipboard: failed to exec into wl-copy (%s)", strerror(errno));
-        exit(69);
-    default: // Parent
-        break;
     }
 
-    close(tmpfile_fd);
+    ret = posix_spawnp(&pid, "wl-copy", &file_actions, nullptr, argv, environ);
+    if (ret != 0) {
+        LogPrint(ERR, "Clipboard: failed to spawn wl-copy (%s)", strerror(ret));
+        goto err;
+    }
+
+    // wl-copy exits as soon as its background copy is running, ReapClipboardProcesses waits for it
+    {
+        std::lock_guard<std::mutex> lock(children_mutex);
+        children.push_back(pid);
+    }
+
+    posix_spawn_file_actions_destroy(&file_actions);
+    close(memfd);
+    return true;
 
 err:
-    if (tmpfile_fd > 0) {
-        close(tmpfile_fd);
+    if (file_actions_initialized) {
+        posix_spawn_file_actions_destroy(&file_actions);
+    }
+    if (memfd >= 0) {
+        close(memfd);
     }
     return false;
 }
 
+bool ReapClipboardProcesses(void) {
+    std::lock_guard<std::mutex> lock(children_mutex);
+    for (size_t i = 0; i < children.size();) {
+        int status;
+        pid_t ret = waitpid(children[i], &status, WNOHANG);
+        if (ret == 0) {
+            i++;
+            continue;
+        }
+        if (ret < 0) {
+            LogPrint(ERR, "Clipboard: waitpid failed (%s)", strerror(errno));
+        } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            LogPrint(ERR, "Clipboard: wl-copy failed");
+        }
+        children[i] = children.back();
+        children.pop_back();
+    }
+    return !children.empty();
+}
+
+uint64_t NewClipboardSerial(void) {
+    std::lock_guard<std::mutex> lock(clipboard_mutex);
+    return ++clipboard_serial;
+}
+
+bool IsClipboardSerialCurrent(uint64_t serial) {
+    std::lock_guard<std::mutex> lock(clipboard_mutex);
+    return serial == clipboard_serial;
+}
+
+bool CopyToClipboard(const Image *image, uint64_t serial) {
+    std::lock_guard<std::mutex> lock(clipboard_mutex);
+
+    if (serial != clipboard_serial) {
+        LogPrint(INFO, "Clipboard: offer %lu is outdated, not copying it", serial);
+        return false;
+    }
+
+    return SpawnWlCopy(image);
+}
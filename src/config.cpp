@@ -24,7 +24,7 @@ static const char *GetDefaultConfigPath(void) {
     return path;
 }
 
-static bool HexStringToVec(const char *hex, ImVec4 *vec) {
+bool HexStringToVec(const char *hex, ImVec4 *vec) {
     long color;
     char *endptr;
     bool has_alpha = true;
@@ -85,6 +85,10 @@ static int ConfigHandler(void *data, const char *section, const char *name, cons
 
     ImGuiStyle *style = (ImGuiStyle *)data;
 
+    if (name == nullptr) {
+        return 1; // start of a new section
+    }
+
     if (MATCH("Colors", "Text")) {
         HexStringToVec(value, &style->Colors[ImGuiCol_Text]);
     } else if (MATCH("Colors", "TextDisabled")) {
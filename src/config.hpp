@@ -16,3 +16,6 @@ extern struct Config config;
 
 bool LoadConfig(const char *config_file_path, ImGuiStyle *style);
 
+// Parses #RRGGBB or #RRGGBBAA, the # is optional
+bool HexStringToVec(const char *hex, ImVec4 *vec);
+
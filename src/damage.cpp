@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <GLFW/glfw3.h>
+#define GLFW_EXPOSE_NATIVE_EGL
+#include <GLFW/glfw3native.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "damage.hpp"
+#include "sdf.hpp"
+#include "log.hpp"
+
+// Frames of damage kept, back buffers older than this are repainted fully
+#define DAMAGE_HISTORY 4
+
+// In framebuffer pixels, top-left origin, empty when x0 >= x1 or y0 >= y1
+struct Rect {
+    int x0, y0, x1, y1;
+};
+
+// One draw command as far as its pixels are concerned
+struct Signature {
+    uint64_t hash;
+    Rect rect;
+};
+
+static const Rect EMPTY_RECT = { 0, 0, 0, 0 };
+
+static struct {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_with_damage = nullptr;
+    PFNEGLSETDAMAGEREGIONKHRPROC set_damage_region = nullptr;
+    bool buffer_age = false;
+
+    int w = 0, h = 0;
+    std::vector<Signature> previous;
+    std::vector<Signature> current;
+    // Damage of the last frames, newest first
+    Rect history[DAMAGE_HISTORY];
+    int history_size = 0;
+    // From AddDamage, in ImGui coordinates
+    ImVec2 added_min = ImVec2(FLT_MAX, FLT_MAX);
+    ImVec2 added_max = ImVec2(-FLT_MAX, -FLT_MAX);
+    Rect frame = EMPTY_RECT;
+} damage;
+
+static bool HasExtension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    const char *p = extensions;
+
+    while (p != nullptr && (p = strstr(p, name)) != nullptr) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
+
+static bool IsEmpty(const Rect &r) {
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+static Rect Union(const Rect &a, const Rect &b) {
+    if (IsEmpty(a)) {
+        return b;
+    }
+    if (IsEmpty(b)) {
+        return a;
+    }
+    return { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+}
+
+static uint64_t Hash(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Rounds out to whole pixels with one to spare for antialiasing, clamped to the framebuffer
+static Rect ToFramebuffer(const ImDrawData *draw_data, ImVec2 min, ImVec2 max) {
+    const ImVec2 scale = draw_data->FramebufferScale;
+    const ImVec2 pos = draw_data->DisplayPos;
+    Rect r = {
+        (int)floorf((min.x - pos.x) * scale.x) - 1, (int)floorf((min.y - pos.y) * scale.y) - 1,
+        (int)ceilf((max.x - pos.x) * scale.x) + 1, (int)ceilf((max.y - pos.y) * scale.y) + 1,
+    };
+    r.x0 = std::max(r.x0, 0);
+    r.y0 = std::max(r.y0, 0);
+    r.x1 = std::min(r.x1, damage.w);
+    r.y1 = std::min(r.y1, damage.h);
+    return r;
+}
+
+static void CollectSignatures(const ImDrawData *draw_data, std::vector<Signature> *out) {
+    out->clear();
+    for (const ImDrawList *draw_list: draw_data->CmdLists) {
+        for (const ImDrawCmd &cmd: draw_list->CmdBuffer) {
+            uint64_t hash = Hash(0xcbf29ce484222325ull, &cmd.ClipRect, sizeof(cmd.ClipRect));
+            ImVec2 min, max;
+
+            if (cmd.UserCallback != nullptr) {
+                // Anything but instanced shapes only changes render state
+                if (cmd.UserCallback == ImDrawCallback_ResetRenderState
+                    || !SdfCommandBounds(&cmd, &min, &max)) {
+                    continue;
+                }
+                hash = Hash(hash, cmd.UserCallbackData, cmd.UserCallbackDataSize);
+            } else {
+                if (cmd.ElemCount == 0) {
+                    continue;
+                }
+                const ImTextureID texture = cmd.GetTexID();
+                hash = Hash(hash, &texture, sizeof(texture));
+                min = ImVec2(FLT_MAX, FLT_MAX);
+                max = ImVec2(-FLT_MAX, -FLT_MAX);
+                const ImDrawIdx *indices = draw_list->IdxBuffer.Data + cmd.IdxOffset;
+                const ImDrawVert *vertices = draw_list->VtxBuffer.Data + cmd.VtxOffset;
+                for (unsigned int i = 0; i < cmd.ElemCount; i++) {
+                    const ImDrawVert &vert = vertices[indices[i]];
+                    hash = Hash(hash, &vert, sizeof(vert));
+                    min.x = std::min(min.x, vert.pos.x);
+                    min.y = std::min(min.y, vert.pos.y);
+                    max.x = std::max(max.x, vert.pos.x);
+                    max.y = std::max(max.y, vert.pos.y);
+                }
+            }
+
+            min = ImVec2(std::max(min.x, cmd.ClipRect.x), std::max(min.y, cmd.ClipRect.y));
+            max = ImVec2(std::min(max.x, cmd.ClipRect.z), std::min(max.y, cmd.ClipRect.w));
+            if (min.x < max.x && min.y < max.y) {
+                out->push_back({ hash, ToFramebuffer(draw_data, min, max) });
+            }
+        }
+    }
+    std::sort(out->begin(), out->end(), [](const Signature &a, const Signature &b) {
+        return a.hash < b.hash;
+    });
+}
+
+// Area of commands that are in only one of the two frames. Draw order isn't compared,
+// the UI doesn't reorder overlapping commands without changing them.
+static Rect DiffSignatures(const std::vector<Signature> &a, const std::vector<Signature> &b) {
+    Rect changed = EMPTY_RECT;
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i].hash < b[j].hash)) {
+            changed = Union(changed, a[i++].rect);
+        } else if (i == a.size() || b[j].hash < a[i].hash) {
+            changed = Union(changed, b[j++].rect);
+        } else {
+            i++;
+            j++;
+        }
+    }
+    return changed;
+}
+
+void InitDamageTracking(GLFWwindow *window) {
+    if (glfwGetWindowAttrib(window, GLFW_CONTEXT_CREATION_API) != GLFW_EGL_CONTEXT_API) {
+        LogPrint(INFO, "Damage: not an EGL context, presenting whole frames");
+        return;
+    }
+    damage.display = glfwGetEGLDisplay();
+    damage.surface = glfwGetEGLSurface(window);
+    if (damage.display == EGL_NO_DISPLAY || damage.surface == EGL_NO_SURFACE) {
+        LogPrint(WARN, "Damage: failed to get the EGL surface, presenting whole frames");
+        return;
+    }
+
+    const char *extensions = eglQueryString(damage.display, EGL_EXTENSIONS);
+    if (HasExtension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+        damage.swap_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (HasExtension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+        // Same signature as the KHR one
+        damage.swap_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+    damage.buffer_age = HasExtension(extensions, "EGL_EXT_buffer_age");
+    if (damage.buffer_age && HasExtension(extensions, "EGL_KHR_partial_update")) {
+        damage.set_damage_region = (PFNEGLSETDAMAGEREGIONKHRPROC)eglGetProcAddress("eglSetDamageRegionKHR");
+    }
+
+    LogPrint(INFO, "Damage: %s repaints, %s presentation%s",
+             damage.buffer_age ? "partial" : "full",
+             damage.swap_with_damage != nullptr ? "damage hinted" : "full",
+             damage.set_damage_region != nullptr ? ", partial update" : "");
+}
+
+void AddDamage(ImVec2 min, ImVec2 max) {
+    damage.added_min = ImVec2(std::min(damage.added_min.x, min.x), std::min(damage.added_min.y, min.y));
+    damage.added_max = ImVec2(std::max(damage.added_max.x, max.x), std::max(damage.added_max.y, max.y));
+}
+
+bool PrepareDamagedFrame(ImDrawData *draw_data) {
+    const int w = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
+    const int h = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+    const Rect full = { 0, 0, w, h };
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+
+    bool resized = w != damage.w || h != damage.h;
+    damage.w = w;
+    damage.h = h;
+    CollectSignatures(draw_data, &damage.current);
+
+    Rect changed;
+    if (resized) {
+        changed = full;
+        damage.history_size = 0;
+    } else {
+        changed = DiffSignatures(damage.previous, damage.current);
+        if (damage.added_min.x < damage.added_max.x) {
+            changed = Union(changed, ToFramebuffer(draw_data, damage.added_min, damage.added_max));
+        }
+    }
+    damage.added_min = ImVec2(FLT_MAX, FLT_MAX);
+    damage.added_max = ImVec2(-FLT_MAX, -FLT_MAX);
+    damage.previous.swap(damage.current);
+    if (IsEmpty(changed)) {
+        return false;
+    }
+
+    // The back buffer holds the frame from age swaps ago, everything that changed since then
+    // has to be repainted. Age 0 means its contents are undefined.
+    Rect repaint = full;
+    if (damage.buffer_age) {
+        EGLint age = 0;
+        eglQuerySurface(damage.display, damage.surface, EGL_BUFFER_AGE_EXT, &age);
+        if (age > 0 && age - 1 <= damage.history_size) {
+            repaint = changed;
+            for (int i = 0; i < age - 1; i++) {
+                repaint = Union(repaint, damage.history[i]);
+            }
+        }
+    }
+    std::copy_backward(damage.history, damage.history + DAMAGE_HISTORY - 1, damage.history + DAMAGE_HISTORY);
+    damage.history[0] = changed;
+    damage.history_size = std::min(damage.history_size + 1, DAMAGE_HISTORY);
+    damage.frame = changed;
+
+    if (damage.set_damage_region != nullptr) {
+        EGLint rect[4] = { repaint.x0, h - repaint.y1, repaint.x1 - repaint.x0, repaint.y1 - repaint.y0 };
+        damage.set_damage_region(damage.display, damage.surface, rect, 1);
+    }
+
+    // Clip everything to the repainted area, commands outside of it are skipped by the backend
+    if (repaint.x0 > 0 || repaint.y0 > 0 || repaint.x1 < w || repaint.y1 < h) {
+        const ImVec2 scale = draw_data->FramebufferScale;
+        const ImVec2 pos = draw_data->DisplayPos;
+        const ImVec4 clip = ImVec4(pos.x + repaint.x0 / scale.x, pos.y + repaint.y0 / scale.y,
+                                   pos.x + repaint.x1 / scale.x, pos.y + repaint.y1 / scale.y);
+        for (ImDrawList *draw_list: draw_data->CmdLists) {
+            for (ImDrawCmd &cmd: draw_list->CmdBuffer) {
+                cmd.ClipRect.x = std::max(cmd.ClipRect.x, clip.x);
+                cmd.ClipRect.y = std::max(cmd.ClipRect.y, clip.y);
+                cmd.ClipRect.z = std::min(cmd.ClipRect.z, clip.z);
+                cmd.ClipRect.w = std::min(cmd.ClipRect.w, clip.w);
+            }
+        }
+    }
+    return true;
+}
+
+void PresentFrame(GLFWwindow *window) {
+    if (damage.swap_with_damage == nullptr) {
+        glfwSwapBuffers(window);
+        return;
+    }
+    const Rect &r = damage.frame;
+    EGLint rect[4] = { r.x0, damage.h - r.y1, r.x1 - r.x0, r.y1 - r.y0 };
+    if (!damage.swap_with_damage(damage.display, damage.surface, rect, 1)) {
+        LogPrint(WARN, "Damage: swap with damage failed (0x%x), presenting whole frames", eglGetError());
+        damage.swap_with_damage = nullptr;
+        glfwSwapBuffers(window);
+    }
+}
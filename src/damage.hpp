@@ -0,0 +1,23 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+struct GLFWwindow;
+
+// Damage tracking for the editor window: every frame's draw commands are compared with the
+// previous frame's, only the area that changed is repainted and the compositor is told about it.
+// Partial repaints need EGL_EXT_buffer_age, damage hints EGL_KHR_swap_buffers_with_damage.
+// Without them whole frames are drawn and presented, but unchanged frames are still skipped.
+void InitDamageTracking(GLFWwindow *window);
+
+// Marks an area (in ImGui coordinates) whose pixels changed while its draw commands
+// stayed the same, e.g. a quad showing a texture that was drawn into
+void AddDamage(ImVec2 min, ImVec2 max);
+
+// Works out what changed since the last frame and clips draw_data to what has to be repainted
+// in the current back buffer. Call after ImGui::Render(). Returns false if nothing changed,
+// the frame then doesn't have to be rendered or presented.
+bool PrepareDamagedFrame(ImDrawData *draw_data);
+
+// Presents the frame prepared by PrepareDamagedFrame
+void PresentFrame(GLFWwindow *window);
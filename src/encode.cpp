@@ -9,7 +9,8 @@
 #include "backends/jxl.hpp"
 
 typedef unsigned char *(*EncoderFunc)(unsigned char *src_data, size_t src_data_size,
-                                      uint32_t src_width, uint32_t src_height, size_t *out_size);
+                                      uint32_t src_width, uint32_t src_height,
+                                      const EncodeParams *params, size_t *out_size);
 
 static const std::unordered_map<Format, EncoderFunc> encoders = {
     {  Format::PNG,  EncodePNG },
@@ -17,7 +18,7 @@ static const std::unordered_map<Format, EncoderFunc> encoders = {
     {  Format::JXL,  EncodeJXL },
 };
 
-Image *EncodeImage(Image *src, Format format) {
+Image *EncodeImage(const Image *src, Format format, const EncodeParams &params) {
     Image *image = nullptr;
     EncoderFunc encoder = nullptr;
     unsigned char *out_buf = nullptr;
@@ -29,10 +30,10 @@ Image *EncodeImage(Image *src, Format format) {
     }
 
     LogPrint(INFO, "Encoder: encoding image of size %dx%d into %s",
-             src->w, src->h, FormatToString(src->format));
+             src->w, src->h, FormatToString(format));
 
     encoder = encoders.find(format)->second;
-    out_buf = encoder(src->data, src->data_size, src->w, src->h, &out_size);
+    out_buf = encoder(src->data, src->data_size, src->w, src->h, &params, &out_size);
     if (out_buf == nullptr) {
         return nullptr;
     }
@@ -2,5 +2,11 @@
 
 #include "image.hpp"
 
-Image *EncodeImage(Image *src, Format format);
+struct EncodeParams {
+    // 1-100, only used by lossy formats. 0 means encoder default, 100 means lossless if possible
+    int quality = 0;
+    // 1-10, lower is faster but produces bigger files. 0 means encoder default
+    int effort = 0;
+};
 
+Image *EncodeImage(const Image *src, Format format, const EncodeParams &params = {});
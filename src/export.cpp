@@ -0,0 +1,235 @@
+#include <chrono>
+#include <climits>
+#include <future>
+#include <mutex>
+
+#include "export.hpp"
+#include "clibpoard.hpp"
+#include "threadpool.hpp"
+#include "log.hpp"
+
+// Effort used for the first clipboard offer, it only has to be fast
+#define FAST_EFFORT 1
+
+typedef std::shared_future<std::shared_ptr<const Image>> EncodeFuture;
+typedef std::promise<std::shared_ptr<const Image>> EncodePromise;
+
+struct CachedEncode {
+    ExportSettings settings;
+    EncodeFuture encoded;
+};
+
+static struct {
+    std::mutex mutex;
+    uint64_t generation = UINT64_MAX;
+    std::shared_ptr<const Image> render;
+    std::vector<CachedEncode> encodes;
+} cache;
+
+static std::mutex export_mutex;
+static uint64_t export_serial = 0;
+static ExportStage export_stage = ExportStage::IDLE;
+static void (*export_stage_callback)(void) = nullptr;
+
+static bool SameSettings(const ExportSettings &a, const ExportSettings &b) {
+    return a.format == b.format
+           && a.params.quality == b.params.quality
+           && a.params.effort == b.params.effort
+           && a.target.max_bytes == b.target.max_bytes
+           && a.target.min_ssim == b.target.min_ssim;
+}
+
+// Must be called with cache.mutex held. Returns an invalid future on miss.
+static EncodeFuture FindCachedEncode(uint64_t generation, const ExportSettings &settings) {
+    if (generation == cache.generation) {
+        for (const auto &entry: cache.encodes) {
+            if (SameSettings(entry.settings, settings)) {
+                return entry.encoded;
+            }
+        }
+    }
+    return EncodeFuture();
+}
+
+static bool IsCachedGeneration(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return generation == cache.generation;
+}
+
+// Only the newest export gets to report its progress
+static void SetExportStage(uint64_t serial, ExportStage stage) {
+    std::lock_guard<std::mutex> lock(export_mutex);
+    if (serial == export_serial) {
+        export_stage = stage;
+        if (export_stage_callback != nullptr) {
+            export_stage_callback();
+        }
+    }
+}
+
+// Clipboard serials double as job ids: a job is superseded once a newer serial exists.
+// A job that owns promise has registered its encode in the cache and must fulfill it
+// even when superseded, newer exports of the same generation may be waiting for it.
+static void RunClipboardExport(std::shared_ptr<const Image> raw_image, ExportSettings settings,
+                               uint64_t serial, uint64_t generation,
+                               EncodeFuture cached, std::shared_ptr<EncodePromise> promise) {
+    size_t fast_size = SIZE_MAX;
+    bool cached_ready = cached.valid()
+                        && cached.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+
+    if (IsClipboardSerialCurrent(serial) && !cached_ready) {
+        SetExportStage(serial, ExportStage::ENCODING);
+        EncodeParams fast_params = settings.params;
+        fast_params.effort = FAST_EFFORT;
+
+        Image *fast_image = EncodeImage(raw_image.get(), settings.format, fast_params);
+        if (fast_image != nullptr && CopyToClipboard(fast_image, serial)) {
+            fast_size = fast_image->data_size;
+        }
+        delete fast_image;
+    }
+
+    std::shared_ptr<const Image> image;
+    if (promise != nullptr) {
+        // Nobody can ask for this encode anymore once the cache moved on to another generation
+        if (IsCachedGeneration(generation)) {
+            SetExportStage(serial, ExportStage::OPTIMIZING);
+            image.reset(EncodeForExport(raw_image.get(), settings));
+        }
+        promise->set_value(image);
+    } else {
+        SetExportStage(serial, ExportStage::OPTIMIZING);
+        image = cached.get();
+    }
+
+    if (!IsClipboardSerialCurrent(serial)) {
+        return;
+    }
+    if (image == nullptr) {
+        SetExportStage(serial, ExportStage::FAILED);
+        return;
+    }
+
+    // A size target may legitimately need a bigger file than the fast offer
+    if (image->data_size < fast_size || EncodeTargetIsSet(settings.target)) {
+        if (fast_size != SIZE_MAX) {
+            LogPrint(INFO, "Export: replacing clipboard offer (%zu -> %zu bytes)",
+                     fast_size, image->data_size);
+        }
+        if (!CopyToClipboard(image.get(), serial)) {
+            SetExportStage(serial, ExportStage::FAILED);
+            return;
+        }
+    }
+
+    SetExportStage(serial, ExportStage::DONE);
+}
+
+Image *EncodeForExport(const Image *raw_image, const ExportSettings &settings) {
+    if (EncodeTargetIsSet(settings.target)) {
+        return EncodeImageToTarget(raw_image, settings.format, settings.target);
+    }
+    return EncodeImage(raw_image, settings.format, settings.params);
+}
+
+std::shared_ptr<const Image> GetCachedRender(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return generation == cache.generation ? cache.render : nullptr;
+}
+
+void CacheRender(uint64_t generation, std::shared_ptr<const Image> raw_image) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (generation != cache.generation) {
+        cache.encodes.clear();
+        cache.generation = generation;
+    }
+    cache.render = raw_image;
+}
+
+void ClearExportCache(void) {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.generation = UINT64_MAX;
+    cache.render.reset();
+    cache.encodes.clear();
+}
+
+void StartClipboardExport(uint64_t generation, std::shared_ptr<const Image> raw_image,
+                          const ExportSettings &settings) {
+    uint64_t serial = NewClipboardSerial();
+    {
+        std::lock_guard<std::mutex> lock(export_mutex);
+        export_serial = serial;
+        export_stage = ExportStage::ENCODING;
+    }
+
+    EncodeFuture cached;
+    std::shared_ptr<EncodePromise> promise;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cached = FindCachedEncode(generation, settings);
+        if (!cached.valid() && generation == cache.generation) {
+            promise = std::make_shared<EncodePromise>();
+            cache.encodes.push_back({ settings, promise->get_future().share() });
+        }
+    }
+    if (cached.valid()) {
+        LogPrint(INFO, "Export: reusing cached %s encode", FormatToString(settings.format));
+    }
+
+    GetThreadPool().Submit([raw_image, settings, serial, generation, cached, promise]() {
+        RunClipboardExport(raw_image, settings, serial, generation, cached, promise);
+    });
+}
+
+void SetExportStageCallback(void (*callback)(void)) {
+    std::lock_guard<std::mutex> lock(export_mutex);
+    export_stage_callback = callback;
+}
+
+ExportStage GetClipboardExportStage(void) {
+    std::lock_guard<std::mutex> lock(export_mutex);
+    return export_stage;
+}
+
+const char *ExportStageToString(ExportStage stage) {
+    switch (stage) {
+    case ExportStage::IDLE:       return "Idle";
+    case ExportStage::ENCODING:   return "Encoding";
+    case ExportStage::OPTIMIZING: return "Copied, optimizing";
+    case ExportStage::DONE:       return "Copied";
+    case ExportStage::FAILED:     return "Failed";
+    default:                      return "?????";
+    }
+}
+
+std::vector<std::shared_ptr<const Image>> ExportImages(uint64_t generation,
+                                                       std::shared_ptr<const Image> raw_image,
+                                                       const std::vector<ExportSettings> &settings) {
+    std::vector<std::shared_ptr<const Image>> images(settings.size());
+    std::vector<EncodeFuture> cached(settings.size());
+    std::vector<size_t> missing;
+
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        for (size_t i = 0; i < settings.size(); i++) {
+            cached[i] = FindCachedEncode(generation, settings[i]);
+            if (!cached[i].valid()) {
+                missing.push_back(i);
+            }
+        }
+    }
+
+    // Every encoder only reads from raw_image, so they can share it without copying
+    ParallelFor(missing.size(), [&](size_t i) {
+        images[missing[i]].reset(EncodeForExport(raw_image.get(), settings[missing[i]]));
+    });
+
+    for (size_t i = 0; i < settings.size(); i++) {
+        if (cached[i].valid()) {
+            LogPrint(INFO, "Export: reusing cached %s encode", FormatToString(settings[i].format));
+            images[i] = cached[i].get();
+        }
+    }
+
+    return images;
+}
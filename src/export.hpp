@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "image.hpp"
+#include "encode.hpp"
+#include "search.hpp"
+
+struct ExportSettings {
+    Format format = Format::PNG;
+    EncodeParams params;
+    EncodeTarget target;
+};
+
+enum class ExportStage {
+    IDLE,
+    ENCODING,   // low effort encode for the first clipboard offer
+    OPTIMIZING, // size optimized encode that replaces the first offer
+    DONE,
+    FAILED,
+};
+
+// Encodes raw_image the way it should end up in a file or on the clipboard
+Image *EncodeForExport(const Image *raw_image, const ExportSettings &settings);
+
+// The export cache holds the last rendered image together with its finished and in-flight
+// encodes. Everything in it belongs to one annotation generation, caching a render of
+// another generation drops the rest.
+std::shared_ptr<const Image> GetCachedRender(uint64_t generation);
+void CacheRender(uint64_t generation, std::shared_ptr<const Image> raw_image);
+void ClearExportCache(void);
+
+// Starts putting raw_image (rendered at generation) on the clipboard from the thread pool
+// and returns right away. A low effort encode is offered first, then it's replaced with the
+// size optimized encode, which is also cached. If the cache already has that encode, finished
+// or in flight, it's reused instead. Starting a new export supersedes the one in flight,
+// which stops at its next stage and never touches the clipboard again.
+void StartClipboardExport(uint64_t generation, std::shared_ptr<const Image> raw_image,
+                          const ExportSettings &settings);
+
+// Stage of the most recently started clipboard export
+ExportStage GetClipboardExportStage(void);
+
+// callback is called from the export's worker thread whenever its stage changes.
+// Once this returns the previous callback is no longer running and won't be called again.
+void SetExportStageCallback(void (*callback)(void));
+
+const char *ExportStageToString(ExportStage stage);
+
+// Encodes raw_image (rendered at generation) with every entry of settings concurrently,
+// waiting for cached encodes instead of redoing them. Failed encodes are returned as nullptr.
+std::vector<std::shared_ptr<const Image>> ExportImages(uint64_t generation,
+                                                       std::shared_ptr<const Image> raw_image,
+                                                       const std::vector<ExportSettings> &settings);
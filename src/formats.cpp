@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <vector>
+#include <string>
 #include <unordered_map>
 #include <cstring>
 
@@ -41,17 +42,43 @@ Format FormatFromString(const char *string) {
         return Format::JPEG;
     } else if (STRCASEEQ(string, "JPEGXL") || STRCASEEQ(string, "JXL")) {
         return Format::JXL;
+    } else if (STRCASEEQ(string, "AUTO")) {
+        return Format::AUTO;
     } else {
         return Format::INVALID;
     }
 }
 
+bool FormatListFromString(const char *string, std::vector<Format> *formats) {
+    std::string list = string;
+    size_t start = 0;
+
+    formats->clear();
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+
+        Format format = FormatFromString(list.substr(start, end - start).c_str());
+        if (format == Format::INVALID) {
+            return false;
+        }
+        formats->push_back(format);
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
 const char *FormatToString(Format format) {
     switch (format) {
     case Format::PNG:     return "PNG";
     case Format::JPEG:    return "JPEG";
     case Format::JXL:     return "JXL";
     case Format::RGBA:    return "RGBA";
+    case Format::AUTO:    return "AUTO";
     case Format::INVALID: return "INVALID";
     default:              return "?????";
     }
@@ -66,6 +93,15 @@ const char *FormatToMIME(Format format) {
     }
 }
 
+const char *FormatToExtension(Format format) {
+    switch (format) {
+    case Format::PNG:     return "png";
+    case Format::JPEG:    return "jpg";
+    case Format::JXL:     return "jxl";
+    default:              return "bin";
+    }
+}
+
 bool CheckFormatSupport(Format format) {
     switch (format) {
     case Format::PNG:
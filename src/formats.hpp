@@ -1,20 +1,26 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 
 enum class Format {
     PNG,
     JPEG,
     JXL,
     RGBA,
+    AUTO, // picked from image content, see ChooseAutoFormat
     INVALID,
 };
 
 Format MatchFormat(const unsigned char *data, size_t data_size);
 Format FormatFromString(const char *string);
+// Parses a comma separated list like "png,jxl", returns false if any entry is invalid
+bool FormatListFromString(const char *string, std::vector<Format> *formats);
 
 const char *FormatToString(Format format);
 const char *FormatToMIME(Format format);
+// File name extension without the dot
+const char *FormatToExtension(Format format);
 
 bool CheckFormatSupport(Format format);
 
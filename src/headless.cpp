@@ -0,0 +1,183 @@
+#include <cstring>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <imgui/imgui.h>
+#include <imgui/backends/imgui_impl_opengl3.h>
+
+#include "headless.hpp"
+#include "sdf.hpp"
+#include "log.hpp"
+
+#define MAX_EGL_DEVICES 16
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+static EGLSurface egl_surface = EGL_NO_SURFACE;
+
+static bool HasExtension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    const char *p = extensions;
+
+    while (p != nullptr && (p = strstr(p, name)) != nullptr) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
+
+static EGLDisplay GetHeadlessDisplay(void) {
+    EGLDisplay display = EGL_NO_DISPLAY;
+
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (extensions == nullptr || get_platform_display == nullptr) {
+        LogPrint(ERR, "EGL: platform displays are not supported");
+        return EGL_NO_DISPLAY;
+    }
+
+    if (HasExtension(extensions, "EGL_MESA_platform_surfaceless")) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) {
+            LogPrint(INFO, "EGL: using surfaceless platform");
+            return display;
+        }
+    }
+
+    if (HasExtension(extensions, "EGL_EXT_platform_device")) {
+        auto query_devices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+        EGLDeviceEXT devices[MAX_EGL_DEVICES];
+        EGLint n_devices = 0;
+        if (query_devices != nullptr && query_devices(MAX_EGL_DEVICES, devices, &n_devices)) {
+            for (EGLint i = 0; i < n_devices && display == EGL_NO_DISPLAY; i++) {
+                display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr);
+            }
+        }
+        if (display != EGL_NO_DISPLAY) {
+            LogPrint(INFO, "EGL: using device platform");
+            return display;
+        }
+    }
+
+    LogPrint(ERR, "EGL: neither surfaceless nor device platform is available");
+    return EGL_NO_DISPLAY;
+}
+
+static bool CreateHeadlessContext(void) {
+    EGLint major, minor;
+    EGLConfig config;
+    EGLint n_configs = 0;
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE,
+    };
+    const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE,
+    };
+
+    egl_display = GetHeadlessDisplay();
+    if (egl_display == EGL_NO_DISPLAY) {
+        goto err;
+    }
+    if (!eglInitialize(egl_display, &major, &minor)) {
+        LogPrint(ERR, "EGL: failed to initialize display (0x%x)", eglGetError());
+        goto err;
+    }
+    LogPrint(INFO, "EGL: version %d.%d (%s)", major, minor, eglQueryString(egl_display, EGL_VENDOR));
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        LogPrint(ERR, "EGL: desktop OpenGL is not supported (0x%x)", eglGetError());
+        goto err;
+    }
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &n_configs) || n_configs < 1) {
+        LogPrint(ERR, "EGL: no suitable config (0x%x)", eglGetError());
+        goto err;
+    }
+
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, nullptr);
+    if (egl_context == EGL_NO_CONTEXT) {
+        LogPrint(ERR, "EGL: failed to create context (0x%x)", eglGetError());
+        goto err;
+    }
+
+    // Everything is drawn into FBOs, a surface is only needed if the driver insists
+    if (!HasExtension(eglQueryString(egl_display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        egl_surface = eglCreatePbufferSurface(egl_display, config, pbuffer_attribs);
+        if (egl_surface == EGL_NO_SURFACE) {
+            LogPrint(ERR, "EGL: failed to create pbuffer surface (0x%x)", eglGetError());
+            goto err;
+        }
+    }
+    if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+        LogPrint(ERR, "EGL: failed to make context current (0x%x)", eglGetError());
+        goto err;
+    }
+
+    return true;
+
+err:
+    ShutdownHeadlessRenderer();
+    return false;
+}
+
+bool InitHeadlessRenderer(const char *glsl_version) {
+    if (!CreateHeadlessContext()) {
+        return false;
+    }
+
+    GLenum err = glewInit();
+    if (err != GLEW_OK && err != 4) {
+        // 4 means GLEW couldn't find a GLX display, which is expected here
+        LogPrint(ERR, "Failed to init GLEW: %s (%d)", glewGetErrorString(err), err);
+        ShutdownHeadlessRenderer();
+        return false;
+    }
+    LogPrint(INFO, "EGL: OpenGL %s on %s", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr; // disable automatic .ini file saving
+    ImGui_ImplOpenGL3_Init(glsl_version);
+
+    // Shapes sample the white pixel of the font atlas, which is only set up by a frame
+    io.DisplaySize = ImVec2(1, 1);
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui::NewFrame();
+    ImGui::EndFrame();
+
+    InitSdfRenderer();
+
+    return true;
+}
+
+void ShutdownHeadlessRenderer(void) {
+    if (ImGui::GetCurrentContext() != nullptr) {
+        ShutdownSdfRenderer();
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui::DestroyContext();
+    }
+
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (egl_surface != EGL_NO_SURFACE) {
+            eglDestroySurface(egl_display, egl_surface);
+        }
+        if (egl_context != EGL_NO_CONTEXT) {
+            eglDestroyContext(egl_display, egl_context);
+        }
+        eglTerminate(egl_display);
+    }
+    egl_display = EGL_NO_DISPLAY;
+    egl_context = EGL_NO_CONTEXT;
+    egl_surface = EGL_NO_SURFACE;
+}
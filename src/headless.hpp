@@ -0,0 +1,8 @@
+#pragma once
+
+// Sets up an OpenGL context with no window and no display connection, plus the ImGui context
+// and OpenGL3 backend the export renderer draws with. Uses the EGL surfaceless platform
+// if available, the EGL device platform otherwise. Works under no compositor at all,
+// e.g. on CI with Mesa llvmpipe.
+bool InitHeadlessRenderer(const char *glsl_version);
+void ShutdownHeadlessRenderer(void);
@@ -11,6 +11,8 @@
 #define ICON_COPY "\xef\x83\x85"
 #define ICON_SLASH "\xef\x9c\x95"
 #define ICON_XMARK "\xef\x80\x8d"
+#define ICON_ERASER "\xef\x84\xad"
+#define ICON_ARROW_POINTER "\xef\x89\x85"
 
 extern void *icons_ttf_start;
 extern void *icons_ttf_end;
@@ -1,4 +1,6 @@
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include "image.hpp"
 
@@ -14,3 +16,53 @@ Image::~Image() {
     free(this->data);
 }
 
+Image *CropImage(const Image *src, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (w == 0 || h == 0 || x > src->w || y > src->h || w > src->w - x || h > src->h - y) {
+        return nullptr;
+    }
+
+    size_t data_size = (size_t)w * h * 4;
+    unsigned char *data = (unsigned char *)malloc(data_size);
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    for (uint32_t row = 0; row < h; row++) {
+        memcpy(data + (size_t)row * w * 4, src->data + ((size_t)(y + row) * src->w + x) * 4,
+               (size_t)w * 4);
+    }
+
+    return new Image(data, data_size, w, h, src->format);
+}
+
+Image *DownscaleImage(const Image *src, uint32_t factor) {
+    uint32_t w = std::max(src->w / factor, 1u);
+    uint32_t h = std::max(src->h / factor, 1u);
+    size_t data_size = (size_t)w * h * 4;
+    unsigned char *data = (unsigned char *)malloc(data_size);
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t sum[4] = { 0, 0, 0, 0 };
+            uint32_t count = 0;
+            for (uint32_t sy = y * factor; sy < std::min((y + 1) * factor, src->h); sy++) {
+                const unsigned char *row = src->data + ((size_t)sy * src->w + x * factor) * 4;
+                for (uint32_t sx = 0; sx < factor && x * factor + sx < src->w; sx++) {
+                    for (int c = 0; c < 4; c++) {
+                        sum[c] += row[sx * 4 + c];
+                    }
+                    count++;
+                }
+            }
+            unsigned char *out = data + ((size_t)y * w + x) * 4;
+            for (int c = 0; c < 4; c++) {
+                out[c] = sum[c] / count;
+            }
+        }
+    }
+
+    return new Image(data, data_size, w, h, src->format);
+}
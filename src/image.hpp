@@ -15,3 +15,8 @@ public:
     Format format;
 };
 
+// Copies the w x h rectangle at x, y out of an RGBA image, nullptr if it doesn't fit
+Image *CropImage(const Image *src, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+// Shrinks an RGBA image by an integer factor using a box filter
+Image *DownscaleImage(const Image *src, uint32_t factor);
@@ -0,0 +1,148 @@
+#include <cmath>
+#include <vector>
+#include <GL/glew.h>
+#include <imgui/imgui.h>
+
+#include "layer.hpp"
+#include "sdf.hpp"
+#include "tessellate.hpp"
+#include "log.hpp"
+
+static struct {
+    GLuint fbo = 0;
+    GLuint color_tex = 0;
+    uint32_t w = 0, h = 0;
+    ShapeDrawLists draw_lists;
+    std::vector<uint32_t> visible;
+    bool failed = false;
+
+    // What the layer currently shows
+    bool valid = false;
+    uint64_t generation = 0;
+    ImVec2 canvas_size;
+    ImVec2 image_offset;
+    float image_scale = 0.0f;
+} layer;
+
+static bool ResizeLayer(uint32_t w, uint32_t h) {
+    if (layer.fbo != 0 && layer.w == w && layer.h == h) {
+        return true;
+    }
+
+    if (layer.fbo == 0) {
+        glGenFramebuffers(1, &layer.fbo);
+        glGenTextures(1, &layer.color_tex);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, layer.color_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer.color_tex, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LogPrint(ERR, "Layer: framebuffer for %ux%u is incomplete (0x%x), drawing shapes directly",
+                 w, h, status);
+        DestroyShapeLayer();
+        layer.failed = true;
+        return false;
+    }
+
+    LogPrint(INFO, "Layer: created %ux%u annotation layer", w, h);
+    layer.w = w;
+    layer.h = h;
+    layer.valid = false;
+    return true;
+}
+
+// Part of the image the canvas shows, zoomed in that's only a few of the shapes
+static BoundingBox VisibleBox(ImVec2 canvas_size, ImVec2 image_offset, float image_scale) {
+    return { image_offset * (-1.0f / image_scale), (canvas_size - image_offset) * (1.0f / image_scale) };
+}
+
+static void RedrawLayer(const ShapeStore &shapes, ImVec2 canvas_size, ImVec2 image_offset,
+                        float image_scale, ImVec2 framebuffer_scale) {
+    const BoundingBox visible = VisibleBox(canvas_size, image_offset, image_scale);
+    TessellateShapes(&layer.draw_lists, shapes, image_offset, image_scale,
+                     ImVec4(0, 0, canvas_size.x, canvas_size.y), &visible);
+
+    ImDrawData draw_data;
+    draw_data.Valid = true;
+    draw_data.DisplayPos = ImVec2(0, 0);
+    draw_data.DisplaySize = canvas_size;
+    draw_data.FramebufferScale = framebuffer_scale;
+    AddShapeDrawLists(&draw_data, &layer.draw_lists);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fbo);
+    glViewport(0, 0, layer.w, layer.h);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    SdfRenderDrawData(&draw_data);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// The layer holds colors already multiplied by alpha, blending them in again would darken
+// antialiased edges and translucent shapes
+static void SetPremultipliedBlend(const ImDrawList *, const ImDrawCmd *) {
+    glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+bool DrawShapeLayer(ImDrawList *draw_list, const ShapeStore &shapes, uint64_t generation,
+                    ImVec2 canvas_pos, ImVec2 canvas_size, ImVec2 image_offset, float image_scale) {
+    const ImVec2 framebuffer_scale = ImGui::GetIO().DisplayFramebufferScale;
+    const uint32_t w = ceilf(canvas_size.x * framebuffer_scale.x);
+    const uint32_t h = ceilf(canvas_size.y * framebuffer_scale.y);
+
+    if (shapes.Size() == 0 || w == 0 || h == 0) {
+        return false;
+    }
+    if (layer.failed || !ResizeLayer(w, h)) {
+        shapes.Query(VisibleBox(canvas_size, image_offset, image_scale), &layer.visible);
+        for (uint32_t i: layer.visible) {
+            shapes.DrawShape(i, draw_list, canvas_pos + image_offset, image_scale);
+        }
+        return false;
+    }
+
+    const bool stale = !layer.valid
+                       || layer.generation != generation
+                       || layer.canvas_size.x != canvas_size.x
+                       || layer.canvas_size.y != canvas_size.y
+                       || layer.image_offset.x != image_offset.x
+                       || layer.image_offset.y != image_offset.y
+                       || layer.image_scale != image_scale;
+    if (stale) {
+        RedrawLayer(shapes, canvas_size, image_offset, image_scale, framebuffer_scale);
+        layer.valid = true;
+        layer.generation = generation;
+        layer.canvas_size = canvas_size;
+        layer.image_offset = image_offset;
+        layer.image_scale = image_scale;
+    }
+
+    // GL rows go bottom-up, so the texture is flipped on the way out
+    draw_list->AddCallback(SetPremultipliedBlend, nullptr);
+    draw_list->AddImage((ImTextureID)layer.color_tex, canvas_pos, canvas_pos + canvas_size,
+                        ImVec2(0, 1), ImVec2(1, 0));
+    draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+    return stale;
+}
+
+void DestroyShapeLayer(void) {
+    DestroyShapeDrawLists(&layer.draw_lists);
+    if (layer.fbo != 0) {
+        glDeleteFramebuffers(1, &layer.fbo);
+        glDeleteTextures(1, &layer.color_tex);
+        layer.fbo = 0;
+        layer.color_tex = 0;
+    }
+    layer.w = 0;
+    layer.h = 0;
+    layer.valid = false;
+}
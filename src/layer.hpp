@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <imgui/imgui.h>
+
+#include "shapes.hpp"
+
+// Annotation layer: committed shapes are drawn once into a texture the size of the canvas
+// and composited on every frame, so frame time doesn't grow with the number of shapes.
+// The layer is redrawn when generation, the canvas size or the image placement changes,
+// with only the shapes inside the canvas. Falls back to drawing the shapes directly if the
+// layer can't be created. Returns true if the layer was redrawn, so the quad showing it
+// has new contents.
+bool DrawShapeLayer(ImDrawList *draw_list, const ShapeStore &shapes, uint64_t generation,
+                    ImVec2 canvas_pos, ImVec2 canvas_size, ImVec2 image_offset, float image_scale);
+
+void DestroyShapeLayer(void);
@@ -1,3 +1,4 @@
+#include <mutex>
 #include <unistd.h>
 #include <stdarg.h>
 
@@ -19,6 +20,9 @@ static struct {
     .max_level = INFO,
 };
 
+// Encoders log from worker threads, don't let their lines get mixed up
+static std::mutex log_mutex;
+
 void LogInit(LogLevel max_level, FILE *stream) {
     config.max_level = max_level;
     config.stream = stream;
@@ -50,6 +54,8 @@ void LogPrint(LogLevel level, const char *fmt, ...) {
         color_str = ANSI_ERROR;
     }
 
+    std::lock_guard<std::mutex> lock(log_mutex);
+
     if (config.colors) {
         fputs(color_str, config.stream);
     }
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "raster.hpp"
+#include "shapes.hpp"
+#include "threadpool.hpp"
+#include "log.hpp"
+
+// Rows per band, every band is drawn by one thread
+#define BAND_ROWS 32
+// Coverage is computed for this many pixels of a row before blending them
+#define SPAN_PIXELS 256
+
+static inline float Clamp01(float f) {
+    return std::min(std::max(f, 0.0f), 1.0f);
+}
+
+static inline float Dot(ImVec2 a, ImVec2 b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+static inline float Length(ImVec2 v) {
+    return sqrtf(Dot(v, v));
+}
+
+// dst = src * a + dst * (1 - a) for the color channels, dst = a + dst * (1 - a) for alpha.
+// Same as glBlendFuncSeparate(SRC_ALPHA, ONE_MINUS_SRC_ALPHA, ONE, ONE_MINUS_SRC_ALPHA),
+// which is what the backend sets up, with the alpha channel blending towards 255.
+static void BlendSpan(unsigned char *dst, const uint8_t *alpha, uint32_t n, ImU32 color) {
+    const uint32_t src = color | IM_COL32_A_MASK;
+    const uint8_t *src_bytes = (const uint8_t *)&src;
+    uint32_t x = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i src16 = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+
+    for (; x + 4 <= n; x += 4) {
+        uint32_t a4;
+        memcpy(&a4, alpha + x, sizeof(a4));
+        if (a4 == 0) {
+            continue;
+        }
+
+        // a0 a1 a2 a3 -> every alpha repeated over the 4 channels of its pixel, 16 bits each
+        __m128i a = _mm_cvtsi32_si128(a4);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+        __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x * 4));
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(src16, a_lo),
+                                   _mm_mullo_epi16(d_lo, _mm_sub_epi16(c255, a_lo)));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(src16, a_hi),
+                                   _mm_mullo_epi16(d_hi, _mm_sub_epi16(c255, a_hi)));
+
+        // Exact rounding division by 255: (t + (t >> 8)) >> 8 with t = v + 128
+        lo = _mm_add_epi16(lo, c128);
+        hi = _mm_add_epi16(hi, c128);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; x < n; x++) {
+        uint32_t a = alpha[x];
+        if (a == 0) {
+            continue;
+        }
+        for (int c = 0; c < 4; c++) {
+            uint32_t t = src_bytes[c] * a + dst[x * 4 + c] * (255 - a) + 128;
+            dst[x * 4 + c] = (t + (t >> 8)) >> 8;
+        }
+    }
+}
+
+// Blends color over every pixel of [min, max) within the target rows,
+// coverage(center) gives the covered fraction of the pixel with that center
+template<typename F>
+static void Fill(RasterTarget *target, ImVec2 min, ImVec2 max, ImU32 color, F coverage) {
+    const float color_alpha = ((color >> IM_COL32_A_SHIFT) & 0xFF);
+    if (color_alpha == 0) {
+        return;
+    }
+
+    const int x0 = std::max((int)floorf(min.x), 0);
+    const int x1 = std::min((int)ceilf(max.x), (int)target->w);
+    const int y0 = std::max((int)floorf(min.y), (int)target->y0);
+    const int y1 = std::min((int)ceilf(max.y), (int)target->y1);
+
+    uint8_t alpha[SPAN_PIXELS];
+    for (int y = y0; y < y1; y++) {
+        unsigned char *row = target->pixels + (size_t)y * target->w * 4;
+        for (int span = x0; span < x1; span += SPAN_PIXELS) {
+            const int n = std::min(SPAN_PIXELS, x1 - span);
+            for (int i = 0; i < n; i++) {
+                ImVec2 center = ImVec2(span + i + 0.5f, y + 0.5f);
+                alpha[i] = color_alpha * coverage(center) + 0.5f;
+            }
+            BlendSpan(row + (size_t)span * 4, alpha, n, color);
+        }
+    }
+}
+
+// Thick antialiased lines in ImDrawList have a solid core of thickness - 1
+// and a 1 pixel fringe on each side, so coverage falls off over [t/2 - 0.5, t/2 + 0.5]
+void RasterPathSegment(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness) {
+    const ImVec2 d = b - a;
+    const float len = Length(d);
+    if (len == 0.0f) {
+        return;
+    }
+    const ImVec2 dir = d / len;
+    const float half = thickness / 2 + 0.5f;
+
+    ImVec2 min = ImVec2(std::min(a.x, b.x), std::min(a.y, b.y)) - ImVec2(half, half);
+    ImVec2 max = ImVec2(std::max(a.x, b.x), std::max(a.y, b.y)) + ImVec2(half, half);
+    Fill(target, min, max, color, [&](ImVec2 p) {
+        ImVec2 ap = p - a;
+        float along = Dot(ap, dir);
+        float across = fabsf(ap.x * dir.y - ap.y * dir.x);
+        return Clamp01(half - across) * Clamp01(std::min(along, len - along) + 0.5f);
+    });
+}
+
+void RasterLine(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness) {
+    // AddLine() moves lines to pixel centers, paths are stroked where they are
+    RasterPathSegment(target, a + ImVec2(0.5f, 0.5f), b + ImVec2(0.5f, 0.5f), color, thickness);
+}
+
+void RasterCircle(RasterTarget *target, ImVec2 center, float radius, ImU32 color, float thickness) {
+    if (radius < 0.5f) {
+        return;
+    }
+    // AddCircle() strokes a path half a pixel inside of radius
+    const float path_radius = radius - 0.5f;
+    const float half = thickness / 2 + 0.5f;
+
+    ImVec2 extent = ImVec2(path_radius + half, path_radius + half);
+    Fill(target, center - extent, center + extent, color, [&](ImVec2 p) {
+        return Clamp01(half - fabsf(Length(p - center) - path_radius));
+    });
+}
+
+void RasterCircleFilled(RasterTarget *target, ImVec2 center, float radius, ImU32 color) {
+    if (radius < 0.5f) {
+        return;
+    }
+    ImVec2 extent = ImVec2(radius + 0.5f, radius + 0.5f);
+    Fill(target, center - extent, center + extent, color, [&](ImVec2 p) {
+        return Clamp01(radius + 0.5f - Length(p - center));
+    });
+}
+
+void RasterRect(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness) {
+    // AddRect() strokes a path half a pixel inside of the corners, joints are mitered
+    ImVec2 min = ImVec2(std::min(a.x, b.x), std::min(a.y, b.y)) + ImVec2(0.5f, 0.5f);
+    ImVec2 max = ImVec2(std::max(a.x, b.x), std::max(a.y, b.y)) - ImVec2(0.5f, 0.5f);
+    const float half = thickness / 2 + 0.5f;
+
+    Fill(target, min - ImVec2(half, half), max + ImVec2(half, half), color, [&](ImVec2 p) {
+        float dx = std::max(min.x - p.x, p.x - max.x);
+        float dy = std::max(min.y - p.y, p.y - max.y);
+        // Negative distances are inside, a miter makes the outside square too
+        float dist = dx < 0 && dy < 0 ? -std::max(dx, dy) : std::max(dx, dy);
+        return Clamp01(half - dist);
+    });
+}
+
+void RasterRectFilled(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color) {
+    // AddRectFilled() without rounding is two plain triangles, no fringe
+    ImVec2 min = ImVec2(std::min(a.x, b.x), std::min(a.y, b.y));
+    ImVec2 max = ImVec2(std::max(a.x, b.x), std::max(a.y, b.y));
+    Fill(target, min, max, color, [&](ImVec2 p) {
+        return (p.x >= min.x && p.x < max.x && p.y >= min.y && p.y < max.y) ? 1.0f : 0.0f;
+    });
+}
+
+void RasterTriangleFilled(RasterTarget *target, ImVec2 a, ImVec2 b, ImVec2 c, ImU32 color) {
+    // Make the winding counter clockwise so inside is on the left of every edge
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0.0f) {
+        return;
+    }
+    if (area < 0.0f) {
+        std::swap(b, c);
+    }
+
+    const ImVec2 points[3] = { a, b, c };
+    ImVec2 normals[3];
+    for (int i = 0; i < 3; i++) {
+        ImVec2 e = points[(i + 1) % 3] - points[i];
+        normals[i] = ImVec2(-e.y, e.x) / Length(e);
+    }
+
+    // Filled convex shapes get a fringe of half a pixel on both sides of the edge
+    ImVec2 min = ImVec2(std::min({ a.x, b.x, c.x }), std::min({ a.y, b.y, c.y })) - ImVec2(0.5f, 0.5f);
+    ImVec2 max = ImVec2(std::max({ a.x, b.x, c.x }), std::max({ a.y, b.y, c.y })) + ImVec2(0.5f, 0.5f);
+    Fill(target, min, max, color, [&](ImVec2 p) {
+        float dist = FLT_MAX;
+        for (int i = 0; i < 3; i++) {
+            dist = std::min(dist, Dot(p - points[i], normals[i]));
+        }
+        return Clamp01(dist + 0.5f);
+    });
+}
+
+std::shared_ptr<const Image> RenderExportCPU(const Image *orig_image, const ShapeStore &shapes) {
+    auto start = std::chrono::steady_clock::now();
+    const size_t data_size = (size_t)orig_image->w * orig_image->h * 4;
+
+    unsigned char *pixels = (unsigned char *)malloc(data_size);
+    if (pixels == nullptr) {
+        LogPrint(ERR, "Raster: failed to allocate %zu bytes", data_size);
+        return nullptr;
+    }
+    memcpy(pixels, orig_image->data, data_size);
+
+    std::vector<BoundingBox> bounds;
+    BoundingBox all;
+    for (size_t s = 0; s < shapes.Size(); s++) {
+        bounds.push_back(shapes.Bounds(s));
+        all.Add(bounds.back());
+    }
+
+    // Only bands that something is drawn into
+    uint32_t first_row = 0, last_row = 0;
+    if (!all.IsEmpty()) {
+        first_row = std::clamp(floorf(all.min.y), 0.0f, (float)orig_image->h);
+        last_row = std::clamp(ceilf(all.max.y), 0.0f, (float)orig_image->h);
+    }
+    const uint32_t first_band = first_row / BAND_ROWS;
+    const uint32_t bands = last_row > first_row ? (last_row + BAND_ROWS - 1) / BAND_ROWS - first_band : 0;
+
+    ParallelFor(bands, [&](size_t i) {
+        RasterTarget target = {
+            .pixels = pixels,
+            .w = orig_image->w,
+            .h = orig_image->h,
+            .y0 = (uint32_t)(first_band + i) * BAND_ROWS,
+            .y1 = std::min((uint32_t)(first_band + i + 1) * BAND_ROWS, orig_image->h),
+        };
+        for (size_t s = 0; s < shapes.Size(); s++) {
+            if (bounds[s].max.y > target.y0 && bounds[s].min.y < target.y1) {
+                shapes.Rasterize(s, &target);
+            }
+        }
+    });
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    LogPrint(INFO, "Raster: %ux%u with %zu shapes in %u bands in %.2f ms",
+             orig_image->w, orig_image->h, shapes.Size(), bands, elapsed.count());
+
+    return std::make_shared<const Image>(pixels, data_size, orig_image->w, orig_image->h,
+                                         Format::RGBA);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <imgui/imgui.h>
+
+#include "image.hpp"
+
+class ShapeStore;
+
+// Rows [y0, y1) of a w x h RGBA image, a thread only ever draws into its own rows
+struct RasterTarget {
+    unsigned char *pixels;
+    uint32_t w, h;
+    uint32_t y0, y1;
+};
+
+// Antialiased primitives that cover the same pixels as the ImDrawList call they are named
+// after, blended source-over the way the OpenGL3 backend blends
+void RasterLine(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness);
+// One segment of PathStroke(), which unlike AddLine() doesn't move points to pixel centers
+void RasterPathSegment(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness);
+void RasterCircle(RasterTarget *target, ImVec2 center, float radius, ImU32 color, float thickness);
+void RasterCircleFilled(RasterTarget *target, ImVec2 center, float radius, ImU32 color);
+void RasterRect(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color, float thickness);
+void RasterRectFilled(RasterTarget *target, ImVec2 a, ImVec2 b, ImU32 color);
+void RasterTriangleFilled(RasterTarget *target, ImVec2 a, ImVec2 b, ImVec2 c, ImU32 color);
+
+// Draws shapes over a copy of orig_image without touching OpenGL.
+// Rows are split into bands which are drawn in parallel.
+std::shared_ptr<const Image> RenderExportCPU(const Image *orig_image, const ShapeStore &shapes);
@@ -0,0 +1,578 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <imgui/imgui.h>
+
+#include "render.hpp"
+#include "sdf.hpp"
+#include "tessellate.hpp"
+#include "log.hpp"
+
+// Unmapped readback buffers kept for reuse, the rest is freed
+#define IDLE_READBACK_BUFFERS 2
+// Above this share of the image it's cheaper to read everything back and skip the paste
+#define FULL_READBACK_RATIO 0.5
+// Largest tile rendered at once, also capped by what the driver supports.
+// Keeps the framebuffer at 64MB even for huge stitched captures.
+#define MAX_TILE_SIZE 4096
+
+struct Region {
+    uint32_t x, y, w, h;
+};
+
+struct ReadbackBuffer {
+    GLuint pbo;
+    size_t size;
+    bool busy; // mapped, or a readback into it is in flight
+};
+
+static struct {
+    uint32_t tile_size = 0;
+    GLuint fbo = 0;
+    GLuint color_tex = 0;
+    // Holds the source pixels of one tile when the image is too big to be a texture
+    GLuint source_tex = 0;
+    uint32_t w = 0, h = 0;
+    ImDrawList *draw_list = nullptr;
+    ShapeDrawLists shape_lists;
+
+    std::vector<ReadbackBuffer> buffers;
+    // Queued readback
+    bool pending = false;
+    GLuint pending_pbo = 0;
+    GLsync pending_fence = nullptr;
+    uint64_t pending_tag = 0;
+    const Image *pending_orig = nullptr;
+    Region pending_region = {};
+    bool pending_full = false;
+    // Tiled renders are read back right away, this is the result
+    std::shared_ptr<const Image> pending_image;
+} renderer;
+
+// Images are released from whatever thread dropped the last reference,
+// the buffers behind them can only be unmapped on the GL thread
+static std::mutex released_mutex;
+static std::condition_variable released_cond;
+static std::vector<GLuint> released_buffers;
+
+uint32_t GetMaxTextureSize(void) {
+    GLint max_texture_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    return std::max(max_texture_size, 64);
+}
+
+static uint32_t GetTileSize(void) {
+    if (renderer.tile_size == 0) {
+        GLint max_viewport[2] = { 0, 0 };
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+        uint32_t size = std::min<uint32_t>(MAX_TILE_SIZE, GetMaxTextureSize());
+        size = std::min<uint32_t>(size, std::max(std::min(max_viewport[0], max_viewport[1]), 64));
+        renderer.tile_size = size;
+        LogPrint(INFO, "Render: exporting in tiles of up to %ux%u", size, size);
+    }
+    return renderer.tile_size;
+}
+
+static bool ResizeTarget(uint32_t w, uint32_t h) {
+    if (renderer.fbo != 0 && renderer.w == w && renderer.h == h) {
+        return true;
+    }
+
+    if (renderer.fbo == 0) {
+        glGenFramebuffers(1, &renderer.fbo);
+        glGenTextures(1, &renderer.color_tex);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, renderer.color_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.color_tex, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LogPrint(ERR, "Render: framebuffer for %ux%u is incomplete (0x%x)", w, h, status);
+        glDeleteFramebuffers(1, &renderer.fbo);
+        glDeleteTextures(1, &renderer.color_tex);
+        renderer.fbo = 0;
+        renderer.color_tex = 0;
+        renderer.w = 0;
+        renderer.h = 0;
+        return false;
+    }
+
+    LogPrint(INFO, "Render: created %ux%u export framebuffer", w, h);
+    renderer.w = w;
+    renderer.h = h;
+    return true;
+}
+
+static ReadbackBuffer *FindBuffer(GLuint pbo) {
+    for (auto &buffer: renderer.buffers) {
+        if (buffer.pbo == pbo) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+static ReadbackBuffer *AcquireBuffer(size_t size) {
+    ReadbackBuffer *buffer = nullptr;
+    for (auto &candidate: renderer.buffers) {
+        if (!candidate.busy) {
+            buffer = &candidate;
+            break;
+        }
+    }
+    if (buffer == nullptr) {
+        renderer.buffers.push_back({ .pbo = 0, .size = 0, .busy = false });
+        buffer = &renderer.buffers.back();
+        glGenBuffers(1, &buffer->pbo);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer->pbo);
+    if (buffer->size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        buffer->size = size;
+    }
+    buffer->busy = true;
+    return buffer;
+}
+
+static void DropPending(void) {
+    if (!renderer.pending) {
+        return;
+    }
+    if (renderer.pending_fence != nullptr) {
+        glDeleteSync(renderer.pending_fence);
+    }
+    // GL orders the old readback before anything that reuses the buffer
+    ReadbackBuffer *buffer = FindBuffer(renderer.pending_pbo);
+    if (buffer != nullptr) {
+        buffer->busy = false;
+    }
+    renderer.pending = false;
+    renderer.pending_fence = nullptr;
+    renderer.pending_image.reset();
+}
+
+// Called from any thread when the last reference to a mapped image is dropped
+static void DeleteMappedImage(Image *image, GLuint pbo) {
+    image->data = nullptr; // not ours to free
+    delete image;
+
+    std::lock_guard<std::mutex> lock(released_mutex);
+    released_buffers.push_back(pbo);
+    released_cond.notify_all();
+}
+
+// Union of shape bounds clamped to the image, rounded out to whole pixels
+static Region AnnotatedRegion(const ShapeStore &shapes,
+                              uint32_t w, uint32_t h) {
+    BoundingBox box;
+    for (size_t i = 0; i < shapes.Size(); i++) {
+        box.Add(shapes.Bounds(i));
+    }
+
+    float x0 = std::max(floorf(box.min.x), 0.0f);
+    float y0 = std::max(floorf(box.min.y), 0.0f);
+    float x1 = std::min(ceilf(box.max.x), (float)w);
+    float y1 = std::min(ceilf(box.max.y), (float)h);
+    if (box.IsEmpty() || x1 <= x0 || y1 <= y0) {
+        return { 0, 0, 0, 0 };
+    }
+    return { (uint32_t)x0, (uint32_t)y0, (uint32_t)(x1 - x0), (uint32_t)(y1 - y0) };
+}
+
+// Draws tile of orig_image with shapes on top into the bottom left corner of the framebuffer,
+// mirrored so glReadPixels returns rows top-down. If image_texture is 0 the source pixels
+// are uploaded for just this tile.
+static void DrawTile(GLuint image_texture, const Image *orig_image, const Region &tile,
+                     const ShapeStore &shapes) {
+    const ImVec2 tile_min = ImVec2(tile.x, tile.y);
+    const ImVec2 tile_max = ImVec2(tile.x + tile.w, tile.y + tile.h);
+    ImVec2 uv_min, uv_max;
+
+    if (image_texture != 0) {
+        uv_min = ImVec2((float)tile.x / orig_image->w, (float)tile.y / orig_image->h);
+        uv_max = ImVec2((float)(tile.x + tile.w) / orig_image->w,
+                        (float)(tile.y + tile.h) / orig_image->h);
+    } else {
+        const uint32_t tile_size = GetTileSize();
+        if (renderer.source_tex == 0) {
+            glGenTextures(1, &renderer.source_tex);
+            glBindTexture(GL_TEXTURE_2D, renderer.source_tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile_size, tile_size,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        // Upload the tile straight out of the full image without repacking it
+        glBindTexture(GL_TEXTURE_2D, renderer.source_tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, orig_image->w);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, tile.x);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, tile.y);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile.w, tile.h,
+                        GL_RGBA, GL_UNSIGNED_BYTE, orig_image->data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+        image_texture = renderer.source_tex;
+        uv_min = ImVec2(0, 0);
+        uv_max = ImVec2((float)tile.w / tile_size, (float)tile.h / tile_size);
+    }
+
+    // Replay the image and shapes into our own draw lists, same as the canvas does but 1:1.
+    // The image goes first in a list of its own, shapes follow in chunks tessellated in parallel.
+    if (renderer.draw_list == nullptr) {
+        renderer.draw_list = IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData());
+    }
+    ImDrawList *draw_list = renderer.draw_list;
+    draw_list->_ResetForNewFrame();
+    draw_list->PushClipRect(tile_min, tile_max);
+    draw_list->PushTextureID(ImGui::GetIO().Fonts->TexID);
+    draw_list->AddImage((ImTextureID)image_texture, tile_min, tile_max, uv_min, uv_max);
+
+    const BoundingBox cull = { tile_min, tile_max };
+    TessellateShapes(&renderer.shape_lists, shapes, ImVec2(0, 0), 1,
+                     ImVec4(tile_min.x, tile_min.y, tile_max.x, tile_max.y), &cull);
+
+    // The backend sets the viewport to DisplaySize, so the tile lands
+    // in the bottom left corner of the framebuffer and nothing else is touched
+    ImDrawData draw_data;
+    draw_data.Valid = true;
+    draw_data.DisplayPos = tile_min;
+    draw_data.DisplaySize = tile_max - tile_min;
+    draw_data.FramebufferScale = ImVec2(1, 1);
+    draw_data.AddDrawList(draw_list);
+    AddShapeDrawLists(&draw_data, &renderer.shape_lists);
+
+    // GL puts the origin at the bottom left, mirror everything vertically within the tile
+    // so rows are read back top-down and the CPU doesn't have to flip them
+    const float mirror = 2.0f * tile.y + tile.h;
+    for (ImDrawList *list: draw_data.CmdLists) {
+        for (ImDrawVert &vert: list->VtxBuffer) {
+            vert.pos.y = mirror - vert.pos.y;
+        }
+        for (ImDrawCmd &cmd: list->CmdBuffer) {
+            float top = cmd.ClipRect.y;
+            cmd.ClipRect.y = mirror - cmd.ClipRect.w;
+            cmd.ClipRect.w = mirror - top;
+        }
+        MirrorSdfInstances(list, mirror);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer.fbo);
+    SdfRenderDrawData(&draw_data);
+}
+
+// Copies a finished tile readback into pixels (laid out like orig_image) and frees the buffer.
+// Buffers are looked up by name, acquiring another one may have moved them.
+static bool StoreTile(GLuint pbo, const Region &tile, unsigned char *pixels, uint32_t w) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    unsigned char *mapped = (unsigned char *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapped != nullptr) {
+        for (uint32_t y = 0; y < tile.h; y++) {
+            memcpy(pixels + ((size_t)(tile.y + y) * w + tile.x) * 4,
+                   mapped + (size_t)y * tile.w * 4, (size_t)tile.w * 4);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        LogPrint(ERR, "Render: failed to map readback buffer for tile at %u,%u", tile.x, tile.y);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    FindBuffer(pbo)->busy = false;
+    return mapped != nullptr;
+}
+
+// Renders region tile by tile into a copy of orig_image. Readbacks alternate between
+// two tile sized buffers, so one tile is copied out while the next one is rendered.
+static std::shared_ptr<const Image> RenderTiled(GLuint image_texture, const Image *orig_image,
+                                                const Region &region,
+                                                const ShapeStore &shapes) {
+    const uint32_t tile_size = GetTileSize();
+    const size_t data_size = (size_t)orig_image->w * orig_image->h * 4;
+
+    unsigned char *pixels = (unsigned char *)malloc(data_size);
+    if (pixels == nullptr) {
+        LogPrint(ERR, "Render: failed to allocate %zu bytes", data_size);
+        return nullptr;
+    }
+    if (region.w != orig_image->w || region.h != orig_image->h) {
+        memcpy(pixels, orig_image->data, data_size);
+    }
+
+    GLuint in_flight = 0;
+    Region in_flight_tile = {};
+    size_t tiles = 0;
+    bool ok = true;
+    for (uint32_t y = region.y; y < region.y + region.h; y += tile_size) {
+        for (uint32_t x = region.x; x < region.x + region.w; x += tile_size) {
+            Region tile = {
+                x, y,
+                std::min(tile_size, region.x + region.w - x),
+                std::min(tile_size, region.y + region.h - y),
+            };
+            DrawTile(image_texture, orig_image, tile, shapes);
+
+            const GLuint pbo = AcquireBuffer((size_t)tile_size * tile_size * 4)->pbo;
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, tile.w, tile.h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            if (in_flight != 0) {
+                ok = StoreTile(in_flight, in_flight_tile, pixels, orig_image->w) && ok;
+            }
+            in_flight = pbo;
+            in_flight_tile = tile;
+            tiles++;
+        }
+    }
+    if (in_flight != 0) {
+        ok = StoreTile(in_flight, in_flight_tile, pixels, orig_image->w) && ok;
+    }
+
+    // A missing tile would be garbage, or the bare image when only part of it was rendered
+    if (!ok) {
+        LogPrint(ERR, "Render: %ux%u region export failed, tiles are missing", region.w, region.h);
+        free(pixels);
+        return nullptr;
+    }
+
+    LogPrint(INFO, "Render: %ux%u region rendered in %zu tiles", region.w, region.h, tiles);
+    return std::make_shared<const Image>(pixels, data_size, orig_image->w, orig_image->h,
+                                         Format::RGBA);
+}
+
+bool QueueExportRender(GLuint image_texture, const Image *orig_image,
+                       const ShapeStore &shapes, uint64_t tag) {
+    const uint32_t w = orig_image->w, h = orig_image->h;
+
+    ReleaseExportBuffers();
+    DropPending();
+
+    Region region = AnnotatedRegion(shapes, w, h);
+    bool full = (double)region.w * region.h >= (double)w * h * FULL_READBACK_RATIO;
+    if (full) {
+        region = { 0, 0, w, h };
+    }
+
+    renderer.pending_tag = tag;
+    renderer.pending_orig = orig_image;
+    renderer.pending_region = region;
+    renderer.pending_full = full;
+    renderer.pending_pbo = 0;
+    renderer.pending_fence = nullptr;
+    if (region.w == 0 || region.h == 0) {
+        // Nothing drawn, the original pixels are the result
+        renderer.pending = true;
+        return true;
+    }
+
+    const uint32_t tile_size = GetTileSize();
+    if (!ResizeTarget(std::min(w, tile_size), std::min(h, tile_size))) {
+        return false;
+    }
+
+    // The canvas texture is a downscaled preview when the image is too big for one
+    if (w > GetMaxTextureSize() || h > GetMaxTextureSize()) {
+        image_texture = 0;
+    }
+
+    if (region.w > tile_size || region.h > tile_size || image_texture == 0) {
+        renderer.pending_image = RenderTiled(image_texture, orig_image, region, shapes);
+        renderer.pending = renderer.pending_image != nullptr;
+        return renderer.pending;
+    }
+
+    DrawTile(image_texture, orig_image, region, shapes);
+
+    // With a pack buffer bound glReadPixels only schedules the copy and returns
+    ReadbackBuffer *buffer = AcquireBuffer((size_t)region.w * region.h * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, region.w, region.h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    renderer.pending = true;
+    renderer.pending_pbo = buffer->pbo;
+    renderer.pending_fence = GLEW_ARB_sync ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : nullptr;
+    glFlush();
+
+    return true;
+}
+
+std::shared_ptr<const Image> CollectExportRender(uint64_t *tag, bool wait) {
+    if (!renderer.pending) {
+        return nullptr;
+    }
+
+    // Without fences there is no way to ask, mapping just blocks until the copy is done
+    if (!wait && renderer.pending_fence != nullptr) {
+        GLenum status = glClientWaitSync(renderer.pending_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return nullptr;
+        }
+    }
+
+    const GLuint pbo = renderer.pending_pbo;
+    const Image *orig_image = renderer.pending_orig;
+    const Region region = renderer.pending_region;
+    const uint32_t w = orig_image->w, h = orig_image->h;
+    const size_t data_size = (size_t)w * h * 4;
+    std::shared_ptr<const Image> tiled_image = std::move(renderer.pending_image);
+    *tag = renderer.pending_tag;
+    if (renderer.pending_fence != nullptr) {
+        glDeleteSync(renderer.pending_fence);
+    }
+    renderer.pending = false;
+    renderer.pending_fence = nullptr;
+    renderer.pending_image.reset();
+
+    if (tiled_image != nullptr) {
+        return tiled_image;
+    }
+
+    unsigned char *mapped = nullptr;
+    if (pbo != 0) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        mapped = (unsigned char *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (mapped == nullptr) {
+            LogPrint(ERR, "Render: failed to map readback buffer");
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            FindBuffer(pbo)->busy = false;
+            return nullptr;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if (renderer.pending_full) {
+        Image *image = new Image(mapped, data_size, w, h, Format::RGBA);
+        return std::shared_ptr<const Image>(image, [pbo](Image *image) {
+            DeleteMappedImage(image, pbo);
+        });
+    }
+
+    // Paste the rendered region onto a copy of the original
+    unsigned char *pixels = (unsigned char *)malloc(data_size);
+    if (pixels != nullptr) {
+        memcpy(pixels, orig_image->data, data_size);
+        for (uint32_t y = 0; mapped != nullptr && y < region.h; y++) {
+            memcpy(pixels + ((size_t)(region.y + y) * w + region.x) * 4,
+                   mapped + (size_t)y * region.w * 4, (size_t)region.w * 4);
+        }
+    } else {
+        LogPrint(ERR, "Render: failed to allocate %zu bytes", data_size);
+    }
+
+    if (mapped != nullptr) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        FindBuffer(pbo)->busy = false;
+    }
+
+    if (pixels == nullptr) {
+        return nullptr;
+    }
+    return std::make_shared<const Image>(pixels, data_size, w, h, Format::RGBA);
+}
+
+std::shared_ptr<const Image> RenderExport(GLuint image_texture, const Image *orig_image,
+                                          const ShapeStore &shapes) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t tag;
+
+    if (!QueueExportRender(image_texture, orig_image, shapes, 0)) {
+        return nullptr;
+    }
+    const Region region = renderer.pending_region;
+    std::shared_ptr<const Image> image = CollectExportRender(&tag, true);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    LogPrint(INFO, "Render: %ux%u region of %ux%u with %zu shapes in %.2f ms",
+             region.w, region.h, orig_image->w, orig_image->h, shapes.Size(), elapsed.count());
+    return image;
+}
+
+void ReleaseExportBuffers(void) {
+    std::vector<GLuint> released;
+    {
+        std::lock_guard<std::mutex> lock(released_mutex);
+        released.swap(released_buffers);
+    }
+    if (released.empty()) {
+        return;
+    }
+
+    for (GLuint pbo: released) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        FindBuffer(pbo)->busy = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Don't sit on a pile of full size buffers after a burst of exports
+    size_t idle = 0;
+    for (auto it = renderer.buffers.begin(); it != renderer.buffers.end();) {
+        if (!it->busy && ++idle > IDLE_READBACK_BUFFERS) {
+            glDeleteBuffers(1, &it->pbo);
+            it = renderer.buffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DestroyExportRenderer(void) {
+    DropPending();
+    ReleaseExportBuffers();
+
+    // Encoders may still be reading from mapped buffers, they are gone with the context
+    for (;;) {
+        size_t mapped = 0;
+        for (const auto &buffer: renderer.buffers) {
+            mapped += buffer.busy;
+        }
+        if (mapped == 0) {
+            break;
+        }
+        LogPrint(INFO, "Render: waiting for %zu exports to finish", mapped);
+
+        std::unique_lock<std::mutex> lock(released_mutex);
+        released_cond.wait(lock, []() { return !released_buffers.empty(); });
+        lock.unlock();
+        ReleaseExportBuffers();
+    }
+
+    for (const auto &buffer: renderer.buffers) {
+        glDeleteBuffers(1, &buffer.pbo);
+    }
+    renderer.buffers.clear();
+
+    if (renderer.draw_list != nullptr) {
+        IM_DELETE(renderer.draw_list);
+        renderer.draw_list = nullptr;
+    }
+    DestroyShapeDrawLists(&renderer.shape_lists);
+    if (renderer.fbo != 0) {
+        glDeleteFramebuffers(1, &renderer.fbo);
+        glDeleteTextures(1, &renderer.color_tex);
+    }
+    if (renderer.source_tex != 0) {
+        glDeleteTextures(1, &renderer.source_tex);
+    }
+    renderer.fbo = 0;
+    renderer.color_tex = 0;
+    renderer.source_tex = 0;
+    renderer.w = 0;
+    renderer.h = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+
+#include "image.hpp"
+#include "shapes.hpp"
+
+// Export renderer: draws shapes over image_texture (the uploaded orig_image) into an offscreen
+// framebuffer that is kept around between calls, then reads it back through a pixel buffer
+// object. Only the region covered by shapes is rendered and read back, it's pasted onto
+// a copy of orig_image. When shapes cover most of the image everything is read back instead
+// and the returned image points straight into the mapped buffer, which is unmapped once
+// the last reference is gone. All functions use the current GL and ImGui contexts and must
+// be called from the thread that owns them.
+
+// Renders and starts an asynchronous readback, tag is handed back on collection.
+// Replaces a readback that was queued before and not collected yet.
+// Images larger than the GL limits are rendered in tiles. If orig_image is bigger than
+// GetMaxTextureSize() in any direction image_texture is ignored (it can only be a downscaled
+// preview then) and tiles are uploaded from orig_image as they are needed.
+// orig_image must stay alive until the render is collected.
+bool QueueExportRender(GLuint image_texture, const Image *orig_image,
+                       const ShapeStore &shapes, uint64_t tag);
+
+// Returns the queued render once its readback is done, nullptr if it's still in flight
+// or nothing is queued. With wait it blocks until the transfer finishes.
+std::shared_ptr<const Image> CollectExportRender(uint64_t *tag, bool wait);
+
+// Queue and collect in one go
+std::shared_ptr<const Image> RenderExport(GLuint image_texture, const Image *orig_image,
+                                          const ShapeStore &shapes);
+
+// Largest texture the current context supports in either direction
+uint32_t GetMaxTextureSize(void);
+
+// Unmaps buffers of images that were released since the last call
+void ReleaseExportBuffers(void);
+
+// Frees GL objects owned by the export renderer, call before destroying the context.
+// Blocks until every image returned by it is released.
+void DestroyExportRenderer(void);
@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <GL/glew.h>
+#include <imgui/imgui.h>
+#include <imgui/backends/imgui_impl_opengl3.h>
+
+#include "sdf.hpp"
+#include "log.hpp"
+
+enum SdfKind : uint32_t {
+    SDF_LINE,
+    SDF_CAPSULE,
+    SDF_CIRCLE,
+    SDF_CIRCLE_FILLED,
+    SDF_RECT,
+    SDF_RECT_FILLED,
+    SDF_ARROW,
+};
+// Set by MirrorSdfInstances, offsets that were added before mirroring have to flip too
+#define SDF_MIRRORED 0x100u
+
+struct SdfInstance {
+    ImVec2 p0;
+    ImVec2 p1;
+    float thickness;
+    float radius;
+    ImU32 color;
+    uint32_t kind;
+};
+
+static const char vertex_shader[] = R"(#version 330 core
+layout(location = 0) in vec4 a_points;
+layout(location = 1) in vec2 a_size;
+layout(location = 2) in vec4 a_color;
+layout(location = 3) in uint a_kind;
+uniform mat4 u_proj;
+out vec2 v_pos;
+flat out vec4 v_points;
+flat out vec2 v_size;
+flat out vec4 v_color;
+flat out uint v_kind;
+
+void main() {
+    // Two triangle strip corners per row, the quad covers the shape plus an antialiasing pixel
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 a = a_points.xy;
+    vec2 b = a_points.zw;
+    float t = a_size.x;
+    float r = a_size.y;
+    uint kind = a_kind & 0xffu;
+    vec2 pos;
+
+    if (kind <= 1u) {
+        // Lines get a quad along their direction so long diagonals don't shade empty space
+        vec2 ab = b - a;
+        float len = length(ab);
+        vec2 dir = len > 0.0 ? ab / len : vec2(1.0, 0.0);
+        vec2 normal = vec2(-dir.y, dir.x);
+        float side = t * 0.5 + 1.0;
+        float cap = kind == 1u ? side : 1.0;
+        pos = mix(a - dir * cap, b + dir * cap, corner.x) + normal * mix(-side, side, corner.y);
+    } else {
+        vec2 lo, hi;
+        if (kind <= 3u) {
+            float extent = r + t * 0.5 + 1.0;
+            lo = a - vec2(extent);
+            hi = a + vec2(extent);
+        } else if (kind <= 5u) {
+            lo = min(a, b) - vec2(t * 0.5 + 1.0);
+            hi = max(a, b) + vec2(t * 0.5 + 1.0);
+        } else {
+            // The head is 4 thicknesses long and 3 wide, all of it is within 4.5 of the tip
+            lo = min(a - vec2(t * 0.5 + 1.0), b - vec2(t * 4.5 + 1.0));
+            hi = max(a + vec2(t * 0.5 + 1.0), b + vec2(t * 4.5 + 1.0));
+        }
+        pos = mix(lo, hi, corner);
+    }
+
+    v_pos = pos;
+    v_points = a_points;
+    v_size = a_size;
+    v_color = a_color;
+    v_kind = a_kind;
+    gl_Position = u_proj * vec4(pos, 0.0, 1.0);
+}
+)";
+
+static const char fragment_shader[] = R"(#version 330 core
+in vec2 v_pos;
+flat in vec4 v_points;
+flat in vec2 v_size;
+flat in vec4 v_color;
+flat in uint v_kind;
+out vec4 out_color;
+
+// Distance to a segment of half width w, with round or butt caps
+float Segment(vec2 p, vec2 a, vec2 b, float w, bool round_caps) {
+    vec2 ab = b - a;
+    float len = length(ab);
+    vec2 dir = len > 0.0 ? ab / len : vec2(1.0, 0.0);
+    vec2 q = p - a;
+    float along = dot(q, dir);
+    if (round_caps) {
+        return length(q - dir * clamp(along, 0.0, len)) - w;
+    }
+    vec2 d = vec2(abs(along - len * 0.5) - len * 0.5, abs(dot(q, vec2(-dir.y, dir.x))) - w);
+    return length(max(d, 0.0)) + min(max(d.x, d.y), 0.0);
+}
+
+// Box with sharp corners, like the mitered outline ImGui draws
+float Box(vec2 p, vec2 lo, vec2 hi) {
+    vec2 d = max(lo - p, p - hi);
+    return max(d.x, d.y);
+}
+
+float Triangle(vec2 p, vec2 p0, vec2 p1, vec2 p2) {
+    vec2 e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;
+    vec2 v0 = p - p0, v1 = p - p1, v2 = p - p2;
+    vec2 pq0 = v0 - e0 * clamp(dot(v0, e0) / dot(e0, e0), 0.0, 1.0);
+    vec2 pq1 = v1 - e1 * clamp(dot(v1, e1) / dot(e1, e1), 0.0, 1.0);
+    vec2 pq2 = v2 - e2 * clamp(dot(v2, e2) / dot(e2, e2), 0.0, 1.0);
+    float s = sign(e0.x * e2.y - e0.y * e2.x);
+    vec2 d = min(min(vec2(dot(pq0, pq0), s * (v0.x * e0.y - v0.y * e0.x)),
+                     vec2(dot(pq1, pq1), s * (v1.x * e1.y - v1.y * e1.x))),
+                     vec2(dot(pq2, pq2), s * (v2.x * e2.y - v2.y * e2.x)));
+    return -sqrt(d.x) * sign(d.y);
+}
+
+void main() {
+    vec2 a = v_points.xy;
+    vec2 b = v_points.zw;
+    float t = v_size.x;
+    float r = v_size.y;
+    uint kind = v_kind & 0xffu;
+    float d;
+
+    if (kind == 0u) {
+        d = Segment(v_pos, a, b, t * 0.5, false);
+    } else if (kind == 1u) {
+        d = Segment(v_pos, a, b, t * 0.5, true);
+    } else if (kind == 2u) {
+        d = abs(length(v_pos - a) - r) - t * 0.5;
+    } else if (kind == 3u) {
+        d = length(v_pos - a) - r;
+    } else if (kind == 4u) {
+        vec2 lo = min(a, b), hi = max(a, b);
+        d = max(Box(v_pos, lo - t * 0.5, hi + t * 0.5), -Box(v_pos, lo + t * 0.5, hi - t * 0.5));
+    } else if (kind == 5u) {
+        // Filled rectangles have no antialiasing in ImGui either
+        if (Box(v_pos, min(a, b), max(a, b)) > 0.0) {
+            discard;
+        }
+        out_color = v_color;
+        return;
+    } else {
+        vec2 dir = a - b;
+        float len = length(dir);
+        if (len == 0.0) {
+            discard;
+        }
+        dir /= len;
+        vec2 normal = vec2(-dir.y, dir.x);
+        float head_length = 4.0 * t;
+        float head_width = 3.0 * t;
+        vec2 line_end = b + dir * head_length * 0.9;
+        vec2 left = b + dir * head_length + normal * head_width * 0.5;
+        vec2 right = b + dir * head_length - normal * head_width * 0.5;
+        // The shaft is an ImGui line and carries its half pixel offset, the head doesn't
+        vec2 offset = (v_kind & 0x100u) != 0u ? vec2(0.5, -0.5) : vec2(0.5, 0.5);
+        d = min(Segment(v_pos, a + offset, line_end + offset, t * 0.5, false),
+                Triangle(v_pos, b, left, right));
+    }
+
+    // Half coverage right on the edge, fading out over one pixel
+    float px = max(fwidth(v_pos.x), fwidth(v_pos.y));
+    float coverage = clamp(0.5 - d / px, 0.0, 1.0);
+    if (coverage <= 0.0) {
+        discard;
+    }
+    out_color = vec4(v_color.rgb, v_color.a * coverage);
+}
+)";
+
+static struct {
+    bool enabled = false;
+    GLuint program = 0;
+    GLint proj_location = -1;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    // Projection and scissor transform of the draw data SdfRenderDrawData is rendering
+    float proj[16] = {};
+    ImVec2 clip_off;
+    ImVec2 clip_scale;
+    float fb_height = 0.0f;
+    // Backend bindings to put back after a batch, looked up once per draw data
+    bool backend_known = false;
+    GLint backend_program = 0;
+    GLint backend_vao = 0;
+    GLint backend_array_buffer = 0;
+} sdf;
+
+static GLuint CompileShader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024] = "";
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        LogPrint(ERR, "SDF: failed to compile %s shader: %s",
+                 type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool InitSdfRenderer(void) {
+    GLuint vs = 0, fs = 0;
+    GLint status = GL_FALSE;
+
+    if (!GLEW_VERSION_3_3) {
+        LogPrint(INFO, "SDF: OpenGL %s is older than 3.3, shapes are tessellated", glGetString(GL_VERSION));
+        return false;
+    }
+
+    vs = CompileShader(GL_VERTEX_SHADER, vertex_shader);
+    fs = CompileShader(GL_FRAGMENT_SHADER, fragment_shader);
+    if (vs == 0 || fs == 0) {
+        goto err;
+    }
+
+    sdf.program = glCreateProgram();
+    glAttachShader(sdf.program, vs);
+    glAttachShader(sdf.program, fs);
+    glLinkProgram(sdf.program);
+    glDetachShader(sdf.program, vs);
+    glDetachShader(sdf.program, fs);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    vs = fs = 0;
+
+    glGetProgramiv(sdf.program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024] = "";
+        glGetProgramInfoLog(sdf.program, sizeof(log), nullptr, log);
+        LogPrint(ERR, "SDF: failed to link shaders: %s", log);
+        goto err;
+    }
+    sdf.proj_location = glGetUniformLocation(sdf.program, "u_proj");
+
+    {
+        GLint last_vao, last_array_buffer;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+
+        glGenVertexArrays(1, &sdf.vao);
+        glGenBuffers(1, &sdf.vbo);
+        glBindVertexArray(sdf.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, sdf.vbo);
+
+        const GLsizei stride = sizeof(SdfInstance);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(SdfInstance, p0));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(SdfInstance, thickness));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(SdfInstance, color));
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, stride, (void *)offsetof(SdfInstance, kind));
+        for (GLuint i = 0; i < 4; i++) {
+            glVertexAttribDivisor(i, 1);
+        }
+
+        glBindVertexArray(last_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+    }
+
+    LogPrint(INFO, "SDF: drawing shapes as instanced quads");
+    sdf.enabled = true;
+    return true;
+
+err:
+    if (vs != 0) {
+        glDeleteShader(vs);
+    }
+    if (fs != 0) {
+        glDeleteShader(fs);
+    }
+    ShutdownSdfRenderer();
+    return false;
+}
+
+void ShutdownSdfRenderer(void) {
+    if (sdf.program != 0) {
+        glDeleteProgram(sdf.program);
+    }
+    if (sdf.vao != 0) {
+        glDeleteVertexArrays(1, &sdf.vao);
+    }
+    if (sdf.vbo != 0) {
+        glDeleteBuffers(1, &sdf.vbo);
+    }
+    sdf = {};
+}
+
+bool SdfEnabled(void) {
+    return sdf.enabled;
+}
+
+// Runs in the middle of ImGui_ImplOpenGL3_RenderDrawData with the backend's state set up.
+// Whatever is changed here has to be put back for the draw commands that follow.
+static void DrawInstances(const ImDrawList *, const ImDrawCmd *cmd) {
+    const SdfInstance *instances = (const SdfInstance *)cmd->UserCallbackData;
+    const size_t size = cmd->UserCallbackDataSize;
+    if (instances == nullptr || size == 0) {
+        return;
+    }
+
+    // Callbacks don't get a scissor from the backend, work it out the way it does
+    const ImVec2 clip_min = (ImVec2(cmd->ClipRect.x, cmd->ClipRect.y) - sdf.clip_off) * sdf.clip_scale;
+    const ImVec2 clip_max = (ImVec2(cmd->ClipRect.z, cmd->ClipRect.w) - sdf.clip_off) * sdf.clip_scale;
+    if (clip_max.x <= clip_min.x || clip_max.y <= clip_min.y) {
+        return;
+    }
+    glScissor((GLint)clip_min.x, (GLint)(sdf.fb_height - clip_max.y),
+              (GLsizei)(clip_max.x - clip_min.x), (GLsizei)(clip_max.y - clip_min.y));
+
+    // The backend binds the same program, vertex array and buffer for all of its draw data
+    if (!sdf.backend_known) {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &sdf.backend_program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &sdf.backend_vao);
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &sdf.backend_array_buffer);
+        sdf.backend_known = true;
+    }
+
+    glUseProgram(sdf.program);
+    glUniformMatrix4fv(sdf.proj_location, 1, GL_FALSE, sdf.proj);
+    glBindVertexArray(sdf.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sdf.vbo);
+    // Fresh storage every time, so earlier draws still reading the old one don't stall us
+    glBufferData(GL_ARRAY_BUFFER, size, instances, GL_STREAM_DRAW);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, size / sizeof(SdfInstance));
+
+    glUseProgram(sdf.backend_program);
+    glBindVertexArray(sdf.backend_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sdf.backend_array_buffer);
+}
+
+void SdfRenderDrawData(ImDrawData *draw_data) {
+    // Same orthographic projection and clip transform as ImGui_ImplOpenGL3_SetupRenderState
+    const float l = draw_data->DisplayPos.x;
+    const float r = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
+    const float t = draw_data->DisplayPos.y;
+    const float b = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
+    const float proj[16] = {
+        2.0f / (r - l),    0.0f,              0.0f,  0.0f,
+        0.0f,              2.0f / (t - b),    0.0f,  0.0f,
+        0.0f,              0.0f,              -1.0f, 0.0f,
+        (r + l) / (l - r), (t + b) / (b - t), 0.0f,  1.0f,
+    };
+    memcpy(sdf.proj, proj, sizeof(proj));
+    sdf.clip_off = draw_data->DisplayPos;
+    sdf.clip_scale = draw_data->FramebufferScale;
+    sdf.fb_height = draw_data->DisplaySize.y * draw_data->FramebufferScale.y;
+    sdf.backend_known = false;
+
+    ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+}
+
+bool SdfCommandBounds(const ImDrawCmd *cmd, ImVec2 *min, ImVec2 *max) {
+    if (cmd->UserCallback != DrawInstances || cmd->UserCallbackData == nullptr) {
+        return false;
+    }
+    const SdfInstance *instances = (const SdfInstance *)cmd->UserCallbackData;
+    const size_t n = cmd->UserCallbackDataSize / sizeof(SdfInstance);
+    *min = ImVec2(FLT_MAX, FLT_MAX);
+    *max = ImVec2(-FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < n; i++) {
+        // Covers the quads of every kind, arrow heads reach furthest
+        const SdfInstance &instance = instances[i];
+        const float extent = std::max(instance.radius + instance.thickness * 0.5f,
+                                      instance.thickness * 4.5f) + 1.0f;
+        min->x = std::min(min->x, std::min(instance.p0.x, instance.p1.x) - extent);
+        min->y = std::min(min->y, std::min(instance.p0.y, instance.p1.y) - extent);
+        max->x = std::max(max->x, std::max(instance.p0.x, instance.p1.x) + extent);
+        max->y = std::max(max->y, std::max(instance.p0.y, instance.p1.y) + extent);
+    }
+    return n > 0;
+}
+
+static void AddInstance(ImDrawList *draw_list, const SdfInstance &instance) {
+    // Nothing was drawn since the last batch and the clip rect is the same, extend it
+    const int cmds = draw_list->CmdBuffer.Size;
+    if (cmds >= 2) {
+        ImDrawCmd &batch = draw_list->CmdBuffer[cmds - 2];
+        const ImDrawCmd &last = draw_list->CmdBuffer[cmds - 1];
+        const ImVec4 &clip = draw_list->_CmdHeader.ClipRect;
+        if (batch.UserCallback == DrawInstances && last.ElemCount == 0
+            && batch.UserCallbackDataOffset + batch.UserCallbackDataSize == draw_list->_CallbacksDataBuf.Size
+            && batch.ClipRect.x == clip.x && batch.ClipRect.y == clip.y
+            && batch.ClipRect.z == clip.z && batch.ClipRect.w == clip.w) {
+            const int offset = draw_list->_CallbacksDataBuf.Size;
+            draw_list->_CallbacksDataBuf.resize(offset + sizeof(instance));
+            memcpy(draw_list->_CallbacksDataBuf.Data + offset, &instance, sizeof(instance));
+            batch.UserCallbackDataSize += sizeof(instance);
+            return;
+        }
+    }
+
+    draw_list->AddCallback(DrawInstances, (void *)&instance, sizeof(instance));
+}
+
+void SdfAddLine(ImDrawList *draw_list, ImVec2 p1, ImVec2 p2, ImU32 color, float thickness) {
+    if ((color & IM_COL32_A_MASK) == 0 || (p1.x == p2.x && p1.y == p2.y)) {
+        return;
+    }
+    AddInstance(draw_list, { p1 + ImVec2(0.5f, 0.5f), p2 + ImVec2(0.5f, 0.5f),
+                             thickness, 0.0f, color, SDF_LINE });
+}
+
+void SdfAddCircle(ImDrawList *draw_list, ImVec2 center, float radius, ImU32 color, float thickness) {
+    if ((color & IM_COL32_A_MASK) == 0 || radius < 0.5f) {
+        return;
+    }
+    AddInstance(draw_list, { center, center, thickness, radius - 0.5f, color, SDF_CIRCLE });
+}
+
+void SdfAddCircleFilled(ImDrawList *draw_list, ImVec2 center, float radius, ImU32 color) {
+    if ((color & IM_COL32_A_MASK) == 0 || radius < 0.5f) {
+        return;
+    }
+    AddInstance(draw_list, { center, center, 0.0f, radius, color, SDF_CIRCLE_FILLED });
+}
+
+void SdfAddRect(ImDrawList *draw_list, ImVec2 p_min, ImVec2 p_max, ImU32 color, float thickness) {
+    if ((color & IM_COL32_A_MASK) == 0) {
+        return;
+    }
+    ImVec2 lo = ImVec2(std::min(p_min.x, p_max.x), std::min(p_min.y, p_max.y)) + ImVec2(0.5f, 0.5f);
+    ImVec2 hi = ImVec2(std::max(p_min.x, p_max.x), std::max(p_min.y, p_max.y)) - ImVec2(0.5f, 0.5f);
+    AddInstance(draw_list, { lo, hi, thickness, 0.0f, color, SDF_RECT });
+}
+
+void SdfAddRectFilled(ImDrawList *draw_list, ImVec2 p_min, ImVec2 p_max, ImU32 color) {
+    if ((color & IM_COL32_A_MASK) == 0) {
+        return;
+    }
+    AddInstance(draw_list, { p_min, p_max, 0.0f, 0.0f, color, SDF_RECT_FILLED });
+}
+
+void SdfAddArrow(ImDrawList *draw_list, ImVec2 start, ImVec2 end, ImU32 color, float thickness) {
+    if ((color & IM_COL32_A_MASK) == 0 || (start.x == end.x && start.y == end.y)) {
+        return;
+    }
+    AddInstance(draw_list, { start, end, thickness, 0.0f, color, SDF_ARROW });
+}
+
+void SdfAddCapsule(ImDrawList *draw_list, ImVec2 p1, ImVec2 p2, ImU32 color, float thickness) {
+    if ((color & IM_COL32_A_MASK) == 0) {
+        return;
+    }
+    AddInstance(draw_list, { p1, p2, thickness, 0.0f, color, SDF_CAPSULE });
+}
+
+void MirrorSdfInstances(ImDrawList *draw_list, float mirror) {
+    for (const ImDrawCmd &cmd: draw_list->CmdBuffer) {
+        if (cmd.UserCallback != DrawInstances || cmd.UserCallbackDataOffset < 0) {
+            continue;
+        }
+        SdfInstance *instances = (SdfInstance *)(draw_list->_CallbacksDataBuf.Data
+                                                 + cmd.UserCallbackDataOffset);
+        const size_t count = cmd.UserCallbackDataSize / sizeof(SdfInstance);
+        for (size_t i = 0; i < count; i++) {
+            instances[i].p0.y = mirror - instances[i].p0.y;
+            instances[i].p1.y = mirror - instances[i].p1.y;
+            instances[i].kind ^= SDF_MIRRORED;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+// Instanced shape renderer: every line, circle, rectangle, arrow and stroke segment is one
+// quad shaded with a signed distance function, instead of thousands of tessellated vertices.
+// Instances are queued into an ImDrawList as a callback, consecutive ones share a draw call,
+// so it works for the canvas, the annotation layer and export framebuffers alike.
+// Needs OpenGL 3.3, callers fall back to ImGui's own primitives when it's not enabled.
+
+// Compiles the shaders, call after the ImGui OpenGL backend is set up.
+// Returns false if the context can't run them.
+bool InitSdfRenderer(void);
+void ShutdownSdfRenderer(void);
+bool SdfEnabled(void);
+
+// Renders draw data with the ImGui OpenGL backend. Use it instead of calling the backend
+// directly, queued instances take their projection and scissor from draw_data.
+void SdfRenderDrawData(ImDrawData *draw_data);
+
+// Same geometry as the ImDrawList call of the same name, including its half pixel offsets
+void SdfAddLine(ImDrawList *draw_list, ImVec2 p1, ImVec2 p2, ImU32 color, float thickness);
+void SdfAddCircle(ImDrawList *draw_list, ImVec2 center, float radius, ImU32 color, float thickness);
+void SdfAddCircleFilled(ImDrawList *draw_list, ImVec2 center, float radius, ImU32 color);
+void SdfAddRect(ImDrawList *draw_list, ImVec2 p_min, ImVec2 p_max, ImU32 color, float thickness);
+void SdfAddRectFilled(ImDrawList *draw_list, ImVec2 p_min, ImVec2 p_max, ImU32 color);
+// Shaft and head of an arrow pointing from start to end, shaped like Arrow::Draw
+void SdfAddArrow(ImDrawList *draw_list, ImVec2 start, ImVec2 end, ImU32 color, float thickness);
+// Segment with round caps, a chain of them makes a stroke with round joins
+void SdfAddCapsule(ImDrawList *draw_list, ImVec2 p1, ImVec2 p2, ImU32 color, float thickness);
+
+// Mirrors queued instances vertically around y = mirror / 2, for draw lists whose
+// vertices are mirrored the same way before rendering
+void MirrorSdfInstances(ImDrawList *draw_list, float mirror);
+
+// Screen area covered by a draw command queued by the calls above.
+// Returns false if cmd isn't one of ours.
+bool SdfCommandBounds(const ImDrawCmd *cmd, ImVec2 *min, ImVec2 *max);
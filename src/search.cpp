@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+#include "search.hpp"
+#include "encode.hpp"
+#include "decode.hpp"
+#include "threadpool.hpp"
+#include "log.hpp"
+
+// The probe pass runs on a downscaled copy of about this many pixels
+#define PROBE_PIXELS (512 * 512)
+// How far outside of the probe estimate the full size search looks
+#define PROBE_MARGIN 10
+// Full size passes, each one encodes up to FULL_TRIALS qualities at once
+#define MAX_FULL_PASSES 3
+#define FULL_TRIALS 4
+
+static const int probe_qualities[] = { 10, 25, 40, 55, 70, 80, 90, 95 };
+
+struct Trial {
+    int quality = 0;
+    Image *encoded = nullptr;
+    float ssim = 1.0f;
+};
+
+// Mean SSIM of luma over 8x8 blocks
+static float ComputeSSIM(const Image *a, const Image *b) {
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    const uint32_t block = 8;
+
+    if (a->w != b->w || a->h != b->h) {
+        return 0.0f;
+    }
+
+    double total = 0.0;
+    size_t blocks = 0;
+    for (uint32_t by = 0; by + block <= a->h; by += block) {
+        for (uint32_t bx = 0; bx + block <= a->w; bx += block) {
+            double sum_a = 0, sum_b = 0, sum_aa = 0, sum_bb = 0, sum_ab = 0;
+            for (uint32_t y = by; y < by + block; y++) {
+                const unsigned char *pa = a->data + ((size_t)y * a->w + bx) * 4;
+                const unsigned char *pb = b->data + ((size_t)y * b->w + bx) * 4;
+                for (uint32_t x = 0; x < block; x++, pa += 4, pb += 4) {
+                    double la = (77 * pa[0] + 150 * pa[1] + 29 * pa[2]) / 256.0;
+                    double lb = (77 * pb[0] + 150 * pb[1] + 29 * pb[2]) / 256.0;
+                    sum_a += la;
+                    sum_b += lb;
+                    sum_aa += la * la;
+                    sum_bb += lb * lb;
+                    sum_ab += la * lb;
+                }
+            }
+            const double n = block * block;
+            double mean_a = sum_a / n, mean_b = sum_b / n;
+            double var_a = sum_aa / n - mean_a * mean_a;
+            double var_b = sum_bb / n - mean_b * mean_b;
+            double cov = sum_ab / n - mean_a * mean_b;
+            total += ((2 * mean_a * mean_b + c1) * (2 * cov + c2))
+                     / ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+            blocks++;
+        }
+    }
+
+    return blocks > 0 ? total / blocks : 1.0f;
+}
+
+static void RunTrials(const Image *src, Format format, bool need_ssim, std::vector<Trial> &trials) {
+    ParallelFor(trials.size(), [&](size_t i) {
+        Trial &trial = trials[i];
+
+        EncodeParams params;
+        params.quality = trial.quality;
+        trial.encoded = EncodeImage(src, format, params);
+        if (trial.encoded == nullptr || !need_ssim) {
+            return;
+        }
+
+        Image *decoded = DecodeImage(trial.encoded->data, trial.encoded->data_size);
+        trial.ssim = decoded != nullptr ? ComputeSSIM(src, decoded) : 0.0f;
+        delete decoded;
+    });
+}
+
+static bool TrialPasses(const Trial &trial, const EncodeTarget &target, double bytes_scale) {
+    if (trial.encoded == nullptr) {
+        return false;
+    }
+    if (target.max_bytes > 0 && trial.encoded->data_size * bytes_scale > target.max_bytes) {
+        return false;
+    }
+    if (target.min_ssim > 0.0f && trial.ssim < target.min_ssim) {
+        return false;
+    }
+    return true;
+}
+
+// Index of the trial to keep: the highest passing quality when prefer_high,
+// otherwise the lowest passing one. -1 if nothing passed.
+static int PickTrial(const std::vector<Trial> &trials, const EncodeTarget &target,
+                     double bytes_scale, bool prefer_high) {
+    int picked = -1;
+    for (int i = 0; i < (int)trials.size(); i++) {
+        if (TrialPasses(trials[i], target, bytes_scale)) {
+            picked = i;
+            if (!prefer_high) {
+                break;
+            }
+        }
+    }
+    return picked;
+}
+
+static void FreeTrials(std::vector<Trial> &trials) {
+    for (auto &trial: trials) {
+        delete trial.encoded;
+        trial.encoded = nullptr;
+    }
+}
+
+Image *EncodeImageToTarget(const Image *src, Format format, const EncodeTarget &target) {
+    if (format == Format::PNG) {
+        Image *image = EncodeImage(src, format);
+        if (image != nullptr && target.max_bytes > 0 && image->data_size > target.max_bytes) {
+            LogPrint(WARN, "Search: %s is lossless, output is %zu bytes which is over %zu",
+                     FormatToString(format), image->data_size, target.max_bytes);
+        }
+        return image;
+    }
+
+    // With a size budget we want the best looking output that fits,
+    // with only a quality target we want the smallest output that is good enough
+    const bool prefer_high = target.max_bytes > 0;
+    const bool need_ssim = target.min_ssim > 0.0f;
+    int lo = 1, hi = 100;
+
+    // Probe pass: coarse sweep on a downscaled copy to find where the answer roughly is
+    uint64_t pixels = (uint64_t)src->w * src->h;
+    uint32_t factor = std::max((uint32_t)ceil(sqrt((double)pixels / PROBE_PIXELS)), 1u);
+    Image *probe = factor > 1 ? DownscaleImage(src, factor) : nullptr;
+    if (probe != nullptr) {
+        double bytes_scale = (double)pixels / ((uint64_t)probe->w * probe->h);
+
+        std::vector<Trial> trials;
+        for (int quality: probe_qualities) {
+            trials.push_back({ .quality = quality });
+        }
+        RunTrials(probe, format, need_ssim, trials);
+
+        const int n = trials.size();
+        int p = PickTrial(trials, target, bytes_scale, prefer_high);
+        if (prefer_high) {
+            lo = p >= 0 ? trials[p].quality : 1;
+            hi = p + 1 < n ? trials[p + 1].quality : 100;
+        } else {
+            lo = p > 0 ? trials[p - 1].quality : 1;
+            hi = p >= 0 ? trials[p].quality : 100;
+        }
+        LogPrint(INFO, "Search: probe at 1/%u scale suggests quality %d-%d", factor, lo, hi);
+
+        FreeTrials(trials);
+        delete probe;
+
+        lo = std::max(lo - PROBE_MARGIN, 1);
+        hi = std::min(hi + PROBE_MARGIN, 100);
+    }
+
+    // Full size passes: narrow [lo, hi] down using real encodes
+    Trial best;
+    for (int pass = 0; pass < MAX_FULL_PASSES && lo <= hi; pass++) {
+        const int n = std::min(FULL_TRIALS, hi - lo + 1);
+
+        std::vector<Trial> trials;
+        for (int i = 0; i < n; i++) {
+            trials.push_back({ .quality = n > 1 ? lo + (hi - lo) * i / (n - 1) : lo });
+        }
+        RunTrials(src, format, need_ssim, trials);
+
+        int p = PickTrial(trials, target, 1.0, prefer_high);
+        if (p >= 0) {
+            bool better = best.encoded == nullptr
+                          || (prefer_high ? trials[p].quality > best.quality
+                                          : trials[p].quality < best.quality);
+            if (better) {
+                delete best.encoded;
+                best = trials[p];
+                trials[p].encoded = nullptr;
+            }
+        }
+
+        if (prefer_high) {
+            if (p < 0) {
+                // Everything was too big, answer is below this range
+                hi = trials[0].quality - 1;
+                lo = 1;
+            } else {
+                hi = p + 1 < n ? trials[p + 1].quality - 1 : hi;
+                lo = trials[p].quality + 1;
+            }
+        } else {
+            if (p < 0) {
+                // Everything looked too bad, answer is above this range
+                lo = trials[n - 1].quality + 1;
+                hi = 100;
+            } else {
+                lo = p > 0 ? trials[p - 1].quality + 1 : lo;
+                hi = trials[p].quality - 1;
+            }
+        }
+
+        FreeTrials(trials);
+    }
+
+    if (best.encoded == nullptr) {
+        EncodeParams params;
+        params.quality = prefer_high ? 1 : 100;
+        LogPrint(WARN, "Search: could not reach the target with %s, using quality %d",
+                 FormatToString(format), params.quality);
+        return EncodeImage(src, format, params);
+    }
+
+    if (need_ssim) {
+        LogPrint(INFO, "Search: picked %s quality %d (%zu bytes, SSIM %.4f)",
+                 FormatToString(format), best.quality, best.encoded->data_size, best.ssim);
+    } else {
+        LogPrint(INFO, "Search: picked %s quality %d (%zu bytes)",
+                 FormatToString(format), best.quality, best.encoded->data_size);
+    }
+    return best.encoded;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+#include "image.hpp"
+
+struct EncodeTarget {
+    // Largest acceptable output size in bytes, 0 means no limit
+    size_t max_bytes = 0;
+    // Smallest acceptable SSIM against the source image, 0 means no limit
+    float min_ssim = 0.0f;
+};
+
+inline bool EncodeTargetIsSet(const EncodeTarget &target) {
+    return target.max_bytes > 0 || target.min_ssim > 0.0f;
+}
+
+// Searches for the encoder quality that satisfies target.
+// With max_bytes the best looking output under the budget is returned,
+// with only min_ssim the smallest output that still looks good enough is returned.
+// If the target can't be met the closest result is returned with a warning.
+Image *EncodeImageToTarget(const Image *src, Format format, const EncodeTarget &target);
@@ -2,33 +2,62 @@
 #include <algorithm>
 
 #include "shapes.hpp"
+#include "sdf.hpp"
 
-Line::Line(ImVec2 start, ImU32 color, float thickness) {
-    this->start = start;
-    this->end = start;
-    this->color = color;
-    this->thickness = thickness;
+// Antialiasing fringe plus some slack for rounding
+#define BOUNDS_MARGIN 2.0f
+// Side of a grid cell in image pixels
+#define GRID_CELL_SIZE 256.0f
+// Shapes touching more cells than this are checked on every query instead
+#define GRID_MAX_CELLS 64
+// Keeps cell coordinates of far away shapes from overflowing
+#define GRID_LIMIT 16777216.0f
+
+void BoundingBox::Add(ImVec2 point, float pad) {
+    this->min.x = std::min(this->min.x, point.x - pad);
+    this->min.y = std::min(this->min.y, point.y - pad);
+    this->max.x = std::max(this->max.x, point.x + pad);
+    this->max.y = std::max(this->max.y, point.y + pad);
+}
+
+void BoundingBox::Add(const BoundingBox &box) {
+    this->min.x = std::min(this->min.x, box.min.x);
+    this->min.y = std::min(this->min.y, box.min.y);
+    this->max.x = std::max(this->max.x, box.max.x);
+    this->max.y = std::max(this->max.y, box.max.y);
 }
 
 void Line::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
+    if (SdfEnabled()) {
+        SdfAddLine(draw_list, offset + this->start * scale, offset + this->end * scale,
+                   this->color, this->thickness * scale);
+        return;
+    }
     draw_list->AddLine(offset + this->start * scale, offset + this->end * scale,
                        this->color, this->thickness * scale);
 }
 
-void Line::Update(ImVec2 pos) {
-    this->end = pos;
+BoundingBox Line::Bounds(void) const {
+    BoundingBox box;
+    box.Add(this->start, this->thickness / 2 + BOUNDS_MARGIN);
+    box.Add(this->end, this->thickness / 2 + BOUNDS_MARGIN);
+    return box;
 }
 
-Circle::Circle(ImVec2 center, ImU32 color, float thickness, bool fill) {
-    this->center = center;
-    this->radius = 0;
-    this->color = color;
-    this->thickness = thickness;
-    this->fill = fill;
+void Line::Rasterize(RasterTarget *target) const {
+    RasterLine(target, this->start, this->end, this->color, this->thickness);
 }
 
 void Circle::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
-    if (this->fill) {
+    if (SdfEnabled()) {
+        if (this->fill) {
+            SdfAddCircleFilled(draw_list, offset + this->center * scale, this->radius * scale,
+                               this->color);
+        } else {
+            SdfAddCircle(draw_list, offset + this->center * scale, this->radius * scale,
+                         this->color, this->thickness * scale);
+        }
+    } else if (this->fill) {
         draw_list->AddCircleFilled(offset + this->center * scale, this->radius * scale,
                                    this->color, 0);
     } else {
@@ -37,21 +66,30 @@ void Circle::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
     }
 }
 
-void Circle::Update(ImVec2 pos) {
-    ImVec2 d = pos - this->center;
-    this->radius = sqrt((d.x * d.x) + (d.y * d.y));
+BoundingBox Circle::Bounds(void) const {
+    BoundingBox box;
+    box.Add(this->center, this->radius + this->thickness / 2 + BOUNDS_MARGIN);
+    return box;
 }
 
-Rectangle::Rectangle(ImVec2 start, ImU32 color, float thickness, bool fill) {
-    this->start = start;
-    this->end = start;
-    this->color = color;
-    this->thickness = thickness;
-    this->fill = fill;
+void Circle::Rasterize(RasterTarget *target) const {
+    if (this->fill) {
+        RasterCircleFilled(target, this->center, this->radius, this->color);
+    } else {
+        RasterCircle(target, this->center, this->radius, this->color, this->thickness);
+    }
 }
 
 void Rectangle::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
-    if (this->fill) {
+    if (SdfEnabled()) {
+        if (this->fill) {
+            SdfAddRectFilled(draw_list, offset + this->start * scale, offset + this->end * scale,
+                             this->color);
+        } else {
+            SdfAddRect(draw_list, offset + this->start * scale, offset + this->end * scale,
+                       this->color, this->thickness * scale);
+        }
+    } else if (this->fill) {
         draw_list->AddRectFilled(offset + this->start * scale, offset + this->end * scale,
                                  this->color, 0.0f, 0);
     } else {
@@ -60,73 +98,849 @@ void Rectangle::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
     }
 }
 
-void Rectangle::Update(ImVec2 pos) {
-    this->end = pos;
+BoundingBox Rectangle::Bounds(void) const {
+    BoundingBox box;
+    box.Add(this->start, this->thickness / 2 + BOUNDS_MARGIN);
+    box.Add(this->end, this->thickness / 2 + BOUNDS_MARGIN);
+    return box;
+}
+
+void Rectangle::Rasterize(RasterTarget *target) const {
+    if (this->fill) {
+        RasterRectFilled(target, this->start, this->end, this->color);
+    } else {
+        RasterRect(target, this->start, this->end, this->color, this->thickness);
+    }
 }
 
-Freeform::Freeform(ImVec2 start, ImU32 color, float thickness) {
-    this->points.push_back(start);
-    this->color = color;
-    this->thickness = thickness;
+// Points closer than this many thicknesses to the previous one are merged into it.
+// Round joins make the difference invisible while the stroke gets far fewer vertices.
+#define FREEFORM_MIN_DISTANCE 0.5f
+// Polylines are split where the stroke turns by more than 60 degrees,
+// mitered joins get long spikes on sharper corners
+#define FREEFORM_MIN_JOIN_COS 0.5f
+// Half the miter length at the sharpest joint that isn't split, 1 / (2 * cos(30))
+#define FREEFORM_MITER_PAD 0.58f
+
+static inline float Distance(ImVec2 a, ImVec2 b) {
+    ImVec2 d = b - a;
+    return sqrtf(d.x * d.x + d.y * d.y);
 }
 
-void Freeform::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
-    auto _ = std::adjacent_find(this->points.begin(), this->points.end(), [&](ImVec2 a, ImVec2 b) {
-        draw_list->AddLine(offset + a * scale, offset + b * scale,
-                           this->color, this->thickness * scale);
-        draw_list->AddCircleFilled(offset + b * scale, this->thickness * scale / 2, this->color);
+// True if the stroke turns too sharply at b for a mitered join
+static bool IsSharpCorner(ImVec2 a, ImVec2 b, ImVec2 c) {
+    ImVec2 d0 = b - a;
+    ImVec2 d1 = c - b;
+    float l0 = sqrtf(d0.x * d0.x + d0.y * d0.y);
+    float l1 = sqrtf(d1.x * d1.x + d1.y * d1.y);
+    if (l0 == 0.0f || l1 == 0.0f) {
         return false;
-    });
+    }
+    return (d0.x * d1.x + d0.y * d1.y) / (l0 * l1) < FREEFORM_MIN_JOIN_COS;
 }
 
-void Freeform::Update(ImVec2 pos) {
-    this->points.push_back(pos);
+static void DrawStroke(const ImVec2 *points, size_t n, ImU32 color, float thickness,
+                       ImDrawList *draw_list, ImVec2 offset, float scale) {
+    thickness *= scale;
+
+    // Opaque strokes are a chain of capsules, the overlaps at the joints would show through
+    // translucent ones so those stay a single polyline
+    if (SdfEnabled() && (color & IM_COL32_A_MASK) == IM_COL32_A_MASK) {
+        if (n == 1) {
+            SdfAddCapsule(draw_list, offset + points[0] * scale, offset + points[0] * scale,
+                          color, thickness);
+        }
+        for (size_t i = 1; i < n; i++) {
+            SdfAddCapsule(draw_list, offset + points[i - 1] * scale, offset + points[i] * scale,
+                          color, thickness);
+        }
+        return;
+    }
+
+    // Round caps, also all there is to a stroke that never moved
+    draw_list->AddCircleFilled(offset + points[0] * scale, thickness / 2, color);
+    if (n == 1) {
+        return;
+    }
+    draw_list->AddCircleFilled(offset + points[n - 1] * scale, thickness / 2, color);
+
+    // One mitered polyline per run between sharp corners, which get a round join instead
+    draw_list->PathLineTo(offset + points[0] * scale);
+    for (size_t i = 1; i + 1 < n; i++) {
+        ImVec2 point = offset + points[i] * scale;
+        draw_list->PathLineTo(point);
+        if (IsSharpCorner(points[i - 1], points[i], points[i + 1])) {
+            draw_list->PathStroke(color, ImDrawFlags_None, thickness);
+            draw_list->AddCircleFilled(point, thickness / 2, color);
+            draw_list->PathLineTo(point);
+        }
+    }
+    draw_list->PathLineTo(offset + points[n - 1] * scale);
+    draw_list->PathStroke(color, ImDrawFlags_None, thickness);
 }
 
-Arrow::Arrow(ImVec2 start, ImU32 color, float thickness) {
-    this->start = start;
-    this->end = start;
-    this->color = color;
-    this->thickness = thickness;
+static BoundingBox StrokeBounds(const ImVec2 *points, size_t n, float thickness) {
+    BoundingBox box;
+    for (size_t i = 0; i < n; i++) {
+        box.Add(points[i], thickness * FREEFORM_MITER_PAD + BOUNDS_MARGIN);
+    }
+    return box;
 }
 
-// Vibe coded, probably bad
-void Arrow::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
-    ImVec2 p0 = offset + this->start * scale;
-    ImVec2 p1 = offset + this->end * scale;
+static void RasterizeStroke(const ImVec2 *points, size_t n, ImU32 color, float thickness,
+                            RasterTarget *target) {
+    // Round joins everywhere, they cover the same pixels as the miters of the
+    // shallow joints within a fraction of a pixel
+    RasterCircleFilled(target, points[0], thickness / 2, color);
+    for (size_t i = 1; i < n; i++) {
+        RasterPathSegment(target, points[i - 1], points[i], color, thickness);
+        RasterCircleFilled(target, points[i], thickness / 2, color);
+    }
+}
 
+// Vibe coded, probably bad
+// Works out where the line ends and where the head corners are, false if there's no direction
+static bool ArrowGeometry(ImVec2 p0, ImVec2 p1, float thickness,
+                          ImVec2 *line_end, ImVec2 *left, ImVec2 *right) {
     ImVec2 dir = p0 - p1;
     float length = sqrtf(dir.x * dir.x + dir.y * dir.y);
-    if (length == 0.0f) return;
+    if (length == 0.0f) return false;
     dir.x /= length;
     dir.y /= length;
 
-    const float thickness_scaled = this->thickness * scale;
-    const float head_length = 4.0f * thickness_scaled;  // Head length proportional to thickness
-    const float head_width = 3.0f * thickness_scaled;   // Head width proportional to thickness
+    const float head_length = 4.0f * thickness;  // Head length proportional to thickness
+    const float head_width = 3.0f * thickness;   // Head width proportional to thickness
 
     // Shift the end of the line back so it doesn't overlap the arrowhead
-    ImVec2 line_end = ImVec2(
+    *line_end = ImVec2(
         p1.x + dir.x * head_length * 0.9,
         p1.y + dir.y * head_length * 0.9
     );
 
-    draw_list->AddLine(p0, line_end, this->color, thickness_scaled);
-
-    ImVec2 left = ImVec2(
+    *left = ImVec2(
         p1.x + dir.x * head_length - dir.y * head_width * 0.5f,
         p1.y + dir.y * head_length + dir.x * head_width * 0.5f
     );
 
-    ImVec2 right = ImVec2(
+    *right = ImVec2(
         p1.x + dir.x * head_length + dir.y * head_width * 0.5f,
         p1.y + dir.y * head_length - dir.x * head_width * 0.5f
     );
 
-    draw_list->AddTriangleFilled(p1, left, right, this->color);
+    return true;
+}
+
+void Arrow::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
+    ImVec2 p0 = offset + this->start * scale;
+    ImVec2 p1 = offset + this->end * scale;
+    const float thickness_scaled = this->thickness * scale;
+
+    if (SdfEnabled()) {
+        SdfAddArrow(draw_list, p0, p1, this->color, thickness_scaled);
+        return;
+    }
+
+    ImVec2 line_end, left, right;
+    if (!ArrowGeometry(p0, p1, thickness_scaled, &line_end, &left, &right)) {
+        return;
+    }
+
+    draw_list->AddLine(p0, line_end, this->color, thickness_scaled);
+    // Clockwise, ImGui only puts the antialiasing fringe outside of clockwise shapes
+    draw_list->AddTriangleFilled(p1, right, left, this->color);
+}
+
+BoundingBox Arrow::Bounds(void) const {
+    // The head is 4 thicknesses long and 3 wide, all of it is within 4.5 of the tip
+    BoundingBox box;
+    box.Add(this->start, this->thickness / 2 + BOUNDS_MARGIN);
+    box.Add(this->end, this->thickness * 4.5f + BOUNDS_MARGIN);
+    return box;
+}
+
+void Arrow::Rasterize(RasterTarget *target) const {
+    ImVec2 line_end, left, right;
+    if (!ArrowGeometry(this->start, this->end, this->thickness, &line_end, &left, &right)) {
+        return;
+    }
+    RasterLine(target, this->start, line_end, this->color, this->thickness);
+    RasterTriangleFilled(target, this->end, left, right, this->color);
+}
+
+static inline float Dot(ImVec2 a, ImVec2 b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+static float SegmentDistance(ImVec2 p, ImVec2 a, ImVec2 b) {
+    const ImVec2 ab = b - a;
+    const float length2 = Dot(ab, ab);
+    const float t = length2 > 0.0f ? std::clamp(Dot(p - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+    return Distance(p, a + ab * t);
 }
 
-void Arrow::Update(ImVec2 pos) {
-    this->end = pos;
+// Zero inside the box
+static float BoxDistance(ImVec2 p, ImVec2 min, ImVec2 max) {
+    const float dx = std::max({ min.x - p.x, 0.0f, p.x - max.x });
+    const float dy = std::max({ min.y - p.y, 0.0f, p.y - max.y });
+    return sqrtf(dx * dx + dy * dy);
 }
 
+// Zero inside the triangle, either winding
+static float TriangleDistance(ImVec2 p, ImVec2 a, ImVec2 b, ImVec2 c) {
+    auto side = [](ImVec2 p, ImVec2 a, ImVec2 b) {
+        return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+    };
+    const float s0 = side(p, a, b), s1 = side(p, b, c), s2 = side(p, c, a);
+    if ((s0 >= 0 && s1 >= 0 && s2 >= 0) || (s0 <= 0 && s1 <= 0 && s2 <= 0)) {
+        return 0.0f;
+    }
+    return std::min({ SegmentDistance(p, a, b), SegmentDistance(p, b, c), SegmentDistance(p, c, a) });
+}
+
+bool Line::Hit(ImVec2 point, float tolerance) const {
+    return SegmentDistance(point, this->start, this->end) <= this->thickness / 2 + tolerance;
+}
+
+void Line::Translate(ImVec2 delta) {
+    this->start += delta;
+    this->end += delta;
+}
+
+bool Circle::Hit(ImVec2 point, float tolerance) const {
+    const float distance = Distance(point, this->center);
+    if (this->fill) {
+        return distance <= this->radius + tolerance;
+    }
+    return fabsf(distance - this->radius) <= this->thickness / 2 + tolerance;
+}
+
+void Circle::Translate(ImVec2 delta) {
+    this->center += delta;
+}
+
+bool Rectangle::Hit(ImVec2 point, float tolerance) const {
+    const ImVec2 min = ImVec2(std::min(this->start.x, this->end.x), std::min(this->start.y, this->end.y));
+    const ImVec2 max = ImVec2(std::max(this->start.x, this->end.x), std::max(this->start.y, this->end.y));
+    const float outside = BoxDistance(point, min, max);
+    if (this->fill) {
+        return outside <= tolerance;
+    }
+    if (outside > 0.0f) {
+        return outside <= this->thickness / 2 + tolerance;
+    }
+    const float inside = std::min({ point.x - min.x, max.x - point.x, point.y - min.y, max.y - point.y });
+    return inside <= this->thickness / 2 + tolerance;
+}
+
+void Rectangle::Translate(ImVec2 delta) {
+    this->start += delta;
+    this->end += delta;
+}
+
+bool Arrow::Hit(ImVec2 point, float tolerance) const {
+    ImVec2 line_end, left, right;
+    if (!ArrowGeometry(this->start, this->end, this->thickness, &line_end, &left, &right)) {
+        return false;
+    }
+    return SegmentDistance(point, this->start, line_end) <= this->thickness / 2 + tolerance
+           || TriangleDistance(point, this->end, left, right) <= tolerance;
+}
+
+void Arrow::Translate(ImVec2 delta) {
+    this->start += delta;
+    this->end += delta;
+}
+
+
+void ShapeStore::Begin(ShapeType type, ImVec2 start, ImU32 color, float thickness, bool fill) {
+    this->drawing = true;
+    this->draft_type = type;
+    this->draft_start = start;
+    this->draft_end = start;
+    this->draft_color = color;
+    this->draft_thickness = thickness;
+    this->draft_fill = fill;
+    this->draft_points.clear();
+    this->draft_points.push_back(start);
+}
+
+void ShapeStore::Update(ImVec2 pos) {
+    if (!this->drawing) {
+        return;
+    }
+    if (this->draft_type != ShapeType::FREEFORM) {
+        this->draft_end = pos;
+        return;
+    }
+
+    // Keep moving the tail until it's far enough from the last kept point
+    const float min_distance = std::max(this->draft_thickness * FREEFORM_MIN_DISTANCE, 1.0f);
+    std::vector<ImVec2> &points = this->draft_points;
+    const size_t n = points.size();
+    if (n >= 2 && Distance(points[n - 2], pos) < min_distance) {
+        points[n - 1] = pos;
+        return;
+    }
+    // A repeated point has no direction and makes the polyline spike
+    if (points[n - 1].x == pos.x && points[n - 1].y == pos.y) {
+        return;
+    }
+    points.push_back(pos);
+}
+
+void ShapeStore::AddPoint(ImVec2 pos) {
+    if (!this->drawing || this->draft_type != ShapeType::FREEFORM) {
+        return;
+    }
+    const ImVec2 last = this->draft_points.back();
+    if (last.x == pos.x && last.y == pos.y) {
+        return;
+    }
+    this->draft_points.push_back(pos);
+}
+
+// Inclusive range of grid cells
+struct CellRange {
+    int x0, y0, x1, y1;
+
+    int64_t Count(void) const {
+        if (x0 > x1 || y0 > y1) {
+            return 0;
+        }
+        return (int64_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+};
+
+static int CellCoordinate(float v) {
+    return (int)std::clamp(floorf(v / GRID_CELL_SIZE), -GRID_LIMIT, GRID_LIMIT);
+}
+
+static CellRange CellsOf(const BoundingBox &box) {
+    return { CellCoordinate(box.min.x), CellCoordinate(box.min.y),
+             CellCoordinate(box.max.x), CellCoordinate(box.max.y) };
+}
+
+static uint64_t CellKey(int x, int y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+void ShapeStore::AddToGrid(uint32_t i) {
+    const CellRange cells = CellsOf(this->bounds[i]);
+
+    if (cells.Count() == 0) {
+        return;
+    }
+    if (cells.Count() > GRID_MAX_CELLS) {
+        this->large.push_back(i);
+        return;
+    }
+    for (int y = cells.y0; y <= cells.y1; y++) {
+        for (int x = cells.x0; x <= cells.x1; x++) {
+            this->grid[CellKey(x, y)].push_back(i);
+        }
+    }
+    if (this->grid_min_x > this->grid_max_x) {
+        this->grid_min_x = cells.x0;
+        this->grid_min_y = cells.y0;
+        this->grid_max_x = cells.x1;
+        this->grid_max_y = cells.y1;
+    } else {
+        this->grid_min_x = std::min(this->grid_min_x, cells.x0);
+        this->grid_min_y = std::min(this->grid_min_y, cells.y0);
+        this->grid_max_x = std::max(this->grid_max_x, cells.x1);
+        this->grid_max_y = std::max(this->grid_max_y, cells.y1);
+    }
+}
+
+// Cells only hold a few shapes each, so they are searched. Query sorts what it finds,
+// the order within a cell doesn't matter.
+static void RemoveIndex(std::vector<uint32_t> *indices, uint32_t i) {
+    auto it = std::find(indices->begin(), indices->end(), i);
+    if (it != indices->end()) {
+        *it = indices->back();
+        indices->pop_back();
+    }
+}
+
+// Has to be called with the bounds the shape was added with
+void ShapeStore::RemoveFromGrid(uint32_t i) {
+    const CellRange cells = CellsOf(this->bounds[i]);
+
+    if (cells.Count() > GRID_MAX_CELLS) {
+        RemoveIndex(&this->large, i);
+        return;
+    }
+    for (int y = cells.y0; y <= cells.y1; y++) {
+        for (int x = cells.x0; x <= cells.x1; x++) {
+            auto cell = this->grid.find(CellKey(x, y));
+            if (cell == this->grid.end()) {
+                continue;
+            }
+            RemoveIndex(&cell->second, i);
+            if (cell->second.empty()) {
+                this->grid.erase(cell);
+            }
+        }
+    }
+}
+
+void ShapeStore::Query(const BoundingBox &box, std::vector<uint32_t> *out) const {
+    out->clear();
+    if (box.IsEmpty()) {
+        return;
+    }
+
+    auto add = [&](const std::vector<uint32_t> &indices) {
+        for (uint32_t i: indices) {
+            if (i < this->live && this->bounds[i].Overlaps(box)) {
+                out->push_back(i);
+            }
+        }
+    };
+
+    CellRange cells = CellsOf(box);
+    cells.x0 = std::max(cells.x0, this->grid_min_x);
+    cells.y0 = std::max(cells.y0, this->grid_min_y);
+    cells.x1 = std::min(cells.x1, this->grid_max_x);
+    cells.y1 = std::min(cells.y1, this->grid_max_y);
+
+    // A box larger than the occupied part of the grid is cheaper to answer by walking the cells there are
+    if (cells.Count() > (int64_t)this->grid.size()) {
+        for (const auto &[key, indices]: this->grid) {
+            const int x = (int32_t)(key >> 32);
+            const int y = (int32_t)(uint32_t)key;
+            if (x >= cells.x0 && x <= cells.x1 && y >= cells.y0 && y <= cells.y1) {
+                add(indices);
+            }
+        }
+    } else if (cells.Count() > 0) {
+        for (int y = cells.y0; y <= cells.y1; y++) {
+            for (int x = cells.x0; x <= cells.x1; x++) {
+                auto cell = this->grid.find(CellKey(x, y));
+                if (cell != this->grid.end()) {
+                    add(cell->second);
+                }
+            }
+        }
+    }
+    add(this->large);
+
+    // Shapes spanning several cells were found once per cell
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
+
+// Undone shapes are always the newest ones, so they sit at the end of every array.
+// Ops past applied only refer to shapes being dropped or have already been undone.
+void ShapeStore::DropRedo(void) {
+    this->history.resize(this->applied);
+    while (this->order.size() > this->live) {
+        ShapeRef ref = this->order.back();
+        if (!ref.erased) {
+            this->RemoveFromGrid(this->order.size() - 1);
+        }
+        this->bounds.pop_back();
+        this->order.pop_back();
+
+        switch (ref.type) {
+        case ShapeType::LINE:
+            this->lines.pop_back();
+            break;
+        case ShapeType::CIRCLE:
+            this->circles.pop_back();
+            break;
+        case ShapeType::RECTANGLE:
+            this->rectangles.pop_back();
+            break;
+        case ShapeType::FREEFORM:
+            this->points.resize(this->freeforms.back().first);
+            this->stroke_nodes.resize(this->freeforms.back().nodes);
+            this->freeforms.pop_back();
+            break;
+        case ShapeType::ARROW:
+            this->arrows.pop_back();
+            break;
+        }
+    }
+}
+
+void ShapeStore::Commit(void) {
+    if (!this->drawing) {
+        return;
+    }
+    this->drawing = false;
+    this->DropRedo();
+
+    const ImVec2 start = this->draft_start;
+    const ImVec2 end = this->draft_end;
+    const ImU32 color = this->draft_color;
+    const float thickness = this->draft_thickness;
+    const bool fill = this->draft_fill;
+    uint32_t index = 0;
+
+    switch (this->draft_type) {
+    case ShapeType::LINE:
+        index = this->lines.size();
+        this->lines.push_back({ start, end, color, thickness });
+        break;
+    case ShapeType::CIRCLE:
+        index = this->circles.size();
+        this->circles.push_back({ start, Distance(start, end), color, thickness, fill });
+        break;
+    case ShapeType::RECTANGLE:
+        index = this->rectangles.size();
+        this->rectangles.push_back({ start, end, color, thickness, fill });
+        break;
+    case ShapeType::FREEFORM:
+        index = this->freeforms.size();
+        this->freeforms.push_back({ (uint32_t)this->points.size(), (uint32_t)this->draft_points.size(),
+                                    (uint32_t)this->stroke_nodes.size(), color, thickness });
+        this->points.insert(this->points.end(), this->draft_points.begin(),
+                            this->draft_points.end());
+        this->BuildStrokeTree(&this->points[this->freeforms.back().first], 0,
+                              this->draft_points.size() - 1);
+        break;
+    case ShapeType::ARROW:
+        index = this->arrows.size();
+        this->arrows.push_back({ start, end, color, thickness });
+        break;
+    }
+
+    this->order.push_back({ this->draft_type, false, index });
+    this->bounds.push_back(this->ComputeBounds(this->order.size() - 1));
+    this->AddToGrid(this->order.size() - 1);
+    this->history.push_back({ OpType::ADD, (uint32_t)this->order.size() - 1, ImVec2(0, 0) });
+    this->applied++;
+    this->live++;
+}
+
+// Leaves get up to this many segments, testing them is cheaper than more levels
+#define STROKE_LEAF_SEGMENTS 8
+
+// Segments go in point order, halving the range keeps neighbours together since strokes
+// are drawn continuously
+void ShapeStore::BuildStrokeTree(const ImVec2 *points, uint32_t first, uint32_t count) {
+    const size_t node = this->stroke_nodes.size();
+    this->stroke_nodes.push_back({ BoundingBox(), first, count, 0 });
+
+    BoundingBox box;
+    if (count > STROKE_LEAF_SEGMENTS) {
+        this->BuildStrokeTree(points, first, count / 2);
+        const size_t right = this->stroke_nodes.size();
+        this->BuildStrokeTree(points, first + count / 2, count - count / 2);
+        box.Add(this->stroke_nodes[node + 1].box);
+        box.Add(this->stroke_nodes[right].box);
+    } else {
+        for (uint32_t i = first; i <= first + count; i++) {
+            box.Add(points[i], 0.0f);
+        }
+    }
+    this->stroke_nodes[node].box = box;
+    this->stroke_nodes[node].next = this->stroke_nodes.size();
+}
+
+bool ShapeStore::HitStroke(const Freeform &stroke, ImVec2 point, float tolerance) const {
+    const ImVec2 *points = &this->points[stroke.first];
+    const float reach = stroke.thickness / 2 + tolerance;
+    const uint32_t end = this->stroke_nodes[stroke.nodes].next;
+
+    uint32_t n = stroke.nodes;
+    while (n < end) {
+        const StrokeNode &node = this->stroke_nodes[n];
+        if (BoxDistance(point, node.box.min, node.box.max) > reach) {
+            n = node.next;
+            continue;
+        }
+        if (node.next == n + 1) {
+            // A stroke that never moved is a dot
+            if (stroke.count == 1) {
+                return Distance(point, points[0]) <= reach;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (SegmentDistance(point, points[i], points[i + 1]) <= reach) {
+                    return true;
+                }
+            }
+        }
+        n++;
+    }
+    return false;
+}
+
+bool ShapeStore::Hit(size_t i, ImVec2 point, float tolerance) const {
+    const ShapeRef ref = this->order[i];
+
+    switch (ref.type) {
+    case ShapeType::LINE:
+        return this->lines[ref.index].Hit(point, tolerance);
+    case ShapeType::CIRCLE:
+        return this->circles[ref.index].Hit(point, tolerance);
+    case ShapeType::RECTANGLE:
+        return this->rectangles[ref.index].Hit(point, tolerance);
+    case ShapeType::FREEFORM:
+        return this->HitStroke(this->freeforms[ref.index], point, tolerance);
+    case ShapeType::ARROW:
+        return this->arrows[ref.index].Hit(point, tolerance);
+    }
+    return false;
+}
+
+bool ShapeStore::HitTest(ImVec2 point, float tolerance, size_t *index) const {
+    BoundingBox box;
+    box.Add(point, tolerance);
+    std::vector<uint32_t> &candidates = this->hit_candidates;
+    this->Query(box, &candidates);
+
+    // Newer shapes are drawn on top
+    for (size_t k = candidates.size(); k > 0; k--) {
+        if (this->Hit(candidates[k - 1], point, tolerance)) {
+            *index = candidates[k - 1];
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShapeStore::SetErased(size_t i, bool erased) {
+    this->order[i].erased = erased;
+    if (erased) {
+        this->RemoveFromGrid(i);
+    } else {
+        this->AddToGrid(i);
+    }
+}
+
+void ShapeStore::Translate(size_t i, ImVec2 delta) {
+    const ShapeRef ref = this->order[i];
+
+    if (!ref.erased) {
+        this->RemoveFromGrid(i);
+    }
+    switch (ref.type) {
+    case ShapeType::LINE:
+        this->lines[ref.index].Translate(delta);
+        break;
+    case ShapeType::CIRCLE:
+        this->circles[ref.index].Translate(delta);
+        break;
+    case ShapeType::RECTANGLE:
+        this->rectangles[ref.index].Translate(delta);
+        break;
+    case ShapeType::FREEFORM: {
+        const Freeform &stroke = this->freeforms[ref.index];
+        for (uint32_t p = stroke.first; p < stroke.first + stroke.count; p++) {
+            this->points[p] += delta;
+        }
+        for (uint32_t n = stroke.nodes; n < this->stroke_nodes[stroke.nodes].next; n++) {
+            this->stroke_nodes[n].box.min += delta;
+            this->stroke_nodes[n].box.max += delta;
+        }
+        break;
+    }
+    case ShapeType::ARROW:
+        this->arrows[ref.index].Translate(delta);
+        break;
+    }
+    this->bounds[i] = this->ComputeBounds(i);
+    if (!ref.erased) {
+        this->AddToGrid(i);
+    }
+}
+
+void ShapeStore::Erase(size_t i) {
+    if (i >= this->live || this->order[i].erased) {
+        return;
+    }
+    this->DropRedo();
+    this->SetErased(i, true);
+    this->history.push_back({ OpType::ERASE, (uint32_t)i, ImVec2(0, 0) });
+    this->applied++;
+}
+
+void ShapeStore::BeginMove(size_t i) {
+    if (i >= this->live || this->order[i].erased) {
+        return;
+    }
+    this->moving = true;
+    this->move_shape = i;
+    this->move_delta = ImVec2(0, 0);
+}
+
+void ShapeStore::UpdateMove(ImVec2 delta) {
+    if (!this->moving) {
+        return;
+    }
+    this->Translate(this->move_shape, delta - this->move_delta);
+    this->move_delta = delta;
+}
+
+void ShapeStore::CommitMove(void) {
+    if (!this->moving) {
+        return;
+    }
+    this->moving = false;
+    if (this->move_delta.x == 0.0f && this->move_delta.y == 0.0f) {
+        return;
+    }
+    // The moved shape is live, dropping what could be redone doesn't touch it
+    this->DropRedo();
+    this->history.push_back({ OpType::MOVE, this->move_shape, this->move_delta });
+    this->applied++;
+}
+
+bool ShapeStore::Undo(void) {
+    this->CommitMove();
+    if (this->applied == 0) {
+        return false;
+    }
+
+    const Op &op = this->history[--this->applied];
+    switch (op.type) {
+    case OpType::ADD:
+        this->live--;
+        break;
+    case OpType::ERASE:
+        this->SetErased(op.shape, false);
+        break;
+    case OpType::MOVE:
+        this->Translate(op.shape, ImVec2(0, 0) - op.delta);
+        break;
+    }
+    return true;
+}
+
+bool ShapeStore::Redo(void) {
+    this->CommitMove();
+    if (this->applied == this->history.size()) {
+        return false;
+    }
+
+    const Op &op = this->history[this->applied++];
+    switch (op.type) {
+    case OpType::ADD:
+        this->live++;
+        break;
+    case OpType::ERASE:
+        this->SetErased(op.shape, true);
+        break;
+    case OpType::MOVE:
+        this->Translate(op.shape, op.delta);
+        break;
+    }
+    return true;
+}
+
+void ShapeStore::Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const {
+    // Creation order decides what ends up on top, consecutive shapes of a type
+    // read consecutive elements of its array
+    for (size_t i = 0; i < this->live; i++) {
+        this->DrawShape(i, draw_list, offset, scale);
+    }
+    this->DrawDraft(draw_list, offset, scale);
+}
+
+void ShapeStore::DrawDraft(ImDrawList *draw_list, ImVec2 offset, float scale) const {
+    if (!this->drawing) {
+        return;
+    }
+    const ImVec2 start = this->draft_start;
+    const ImVec2 end = this->draft_end;
+    const ImU32 color = this->draft_color;
+    const float thickness = this->draft_thickness;
+    const bool fill = this->draft_fill;
+
+    switch (this->draft_type) {
+    case ShapeType::LINE:
+        Line{ start, end, color, thickness }.Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::CIRCLE:
+        Circle{ start, Distance(start, end), color, thickness, fill }.Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::RECTANGLE:
+        Rectangle{ start, end, color, thickness, fill }.Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::FREEFORM:
+        DrawStroke(this->draft_points.data(), this->draft_points.size(), color, thickness,
+                   draw_list, offset, scale);
+        break;
+    case ShapeType::ARROW:
+        Arrow{ start, end, color, thickness }.Draw(draw_list, offset, scale);
+        break;
+    }
+}
+
+void ShapeStore::DrawShape(size_t i, ImDrawList *draw_list, ImVec2 offset, float scale) const {
+    const ShapeRef ref = this->order[i];
+    if (ref.erased) {
+        return;
+    }
+
+    switch (ref.type) {
+    case ShapeType::LINE:
+        this->lines[ref.index].Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::CIRCLE:
+        this->circles[ref.index].Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::RECTANGLE:
+        this->rectangles[ref.index].Draw(draw_list, offset, scale);
+        break;
+    case ShapeType::FREEFORM: {
+        const Freeform &stroke = this->freeforms[ref.index];
+        DrawStroke(&this->points[stroke.first], stroke.count, stroke.color, stroke.thickness,
+                   draw_list, offset, scale);
+        break;
+    }
+    case ShapeType::ARROW:
+        this->arrows[ref.index].Draw(draw_list, offset, scale);
+        break;
+    }
+}
+
+BoundingBox ShapeStore::ComputeBounds(size_t i) const {
+    const ShapeRef ref = this->order[i];
+
+    switch (ref.type) {
+    case ShapeType::LINE:
+        return this->lines[ref.index].Bounds();
+    case ShapeType::CIRCLE:
+        return this->circles[ref.index].Bounds();
+    case ShapeType::RECTANGLE:
+        return this->rectangles[ref.index].Bounds();
+    case ShapeType::FREEFORM: {
+        const Freeform &stroke = this->freeforms[ref.index];
+        return StrokeBounds(&this->points[stroke.first], stroke.count, stroke.thickness);
+    }
+    case ShapeType::ARROW:
+        return this->arrows[ref.index].Bounds();
+    }
+    return BoundingBox();
+}
+
+void ShapeStore::Rasterize(size_t i, RasterTarget *target) const {
+    const ShapeRef ref = this->order[i];
+    if (ref.erased) {
+        return;
+    }
+
+    switch (ref.type) {
+    case ShapeType::LINE:
+        this->lines[ref.index].Rasterize(target);
+        break;
+    case ShapeType::CIRCLE:
+        this->circles[ref.index].Rasterize(target);
+        break;
+    case ShapeType::RECTANGLE:
+        this->rectangles[ref.index].Rasterize(target);
+        break;
+    case ShapeType::FREEFORM: {
+        const Freeform &stroke = this->freeforms[ref.index];
+        RasterizeStroke(&this->points[stroke.first], stroke.count, stroke.color,
+                        stroke.thickness, target);
+        break;
+    }
+    case ShapeType::ARROW:
+        this->arrows[ref.index].Rasterize(target);
+        break;
+    }
+}
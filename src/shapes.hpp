@@ -1,73 +1,231 @@
 #pragma once
 
-#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cfloat>
 #include <imgui/imgui.h>
 
-class Shape {
-public:
-    virtual void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const = 0;
-    virtual void Update(ImVec2 pos) = 0;
-    virtual ~Shape() = default;
+#include "raster.hpp"
+
+// Axis aligned box in image coordinates, empty until something is added to it
+struct BoundingBox {
+    ImVec2 min = ImVec2(FLT_MAX, FLT_MAX);
+    ImVec2 max = ImVec2(-FLT_MAX, -FLT_MAX);
+
+    bool IsEmpty(void) const { return min.x > max.x || min.y > max.y; }
+    bool Overlaps(const BoundingBox &other) const {
+        return max.x > other.min.x && min.x < other.max.x && max.y > other.min.y && min.y < other.max.y;
+    }
+    void Add(ImVec2 point, float pad);
+    void Add(const BoundingBox &box);
 };
 
-class Line: public Shape {
-public:
-    Line(ImVec2 start, ImU32 color, float thickness);
-    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const override;
-    void Update(ImVec2 pos) override;
-private:
+enum class ShapeType : uint8_t {
+    LINE,
+    CIRCLE,
+    RECTANGLE,
+    FREEFORM,
+    ARROW,
+};
+
+// Shapes are plain values kept in per type arrays of a ShapeStore.
+// Draw works in screen space, Bounds and Rasterize in image space at scale 1.
+// Bounds is a conservative box around every pixel Draw can touch,
+// including line thickness, arrowheads and antialiasing fringe.
+// Hit tells if point is within tolerance of what Draw covers, without the fringe.
+
+struct Line {
     ImVec2 start;
     ImVec2 end;
     ImU32 color;
     float thickness;
+
+    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    BoundingBox Bounds(void) const;
+    void Rasterize(RasterTarget *target) const;
+    bool Hit(ImVec2 point, float tolerance) const;
+    void Translate(ImVec2 delta);
 };
 
-class Circle: public Shape {
-public:
-    Circle(ImVec2 center, ImU32 color, float thickness, bool fill);
-    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const override;
-    void Update(ImVec2 pos) override;
-private:
+struct Circle {
     ImVec2 center;
     float radius;
     ImU32 color;
     float thickness;
     bool fill;
+
+    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    BoundingBox Bounds(void) const;
+    void Rasterize(RasterTarget *target) const;
+    bool Hit(ImVec2 point, float tolerance) const;
+    void Translate(ImVec2 delta);
 };
 
-class Rectangle: public Shape {
-public:
-    Rectangle(ImVec2 top_left, ImU32 color, float thickness, bool fill);
-    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const override;
-    void Update(ImVec2 pos) override;
-private:
+struct Rectangle {
     ImVec2 start;
     ImVec2 end;
     ImU32 color;
     float thickness;
     bool fill;
+
+    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    BoundingBox Bounds(void) const;
+    void Rasterize(RasterTarget *target) const;
+    bool Hit(ImVec2 point, float tolerance) const;
+    void Translate(ImVec2 delta);
 };
 
-class Freeform: public Shape {
-public:
-    Freeform(ImVec2 start, ImU32 color, float thickness);
-    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const override;
-    void Update(ImVec2 pos) override;
-private:
-    std::list<ImVec2> points;
+// Points [first, first + count) of the store's point pool, segments between them are
+// hit tested through a tree starting at node nodes of the store's node pool
+struct Freeform {
+    uint32_t first;
+    uint32_t count;
+    uint32_t nodes;
     ImU32 color;
     float thickness;
 };
 
-class Arrow: public Shape {
-public:
-    Arrow(ImVec2 start, ImU32 color, float thickness);
-    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const override;
-    void Update(ImVec2 pos) override;
-private:
+struct Arrow {
     ImVec2 start;
     ImVec2 end;
     ImU32 color;
     float thickness;
+
+    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    BoundingBox Bounds(void) const;
+    void Rasterize(RasterTarget *target) const;
+    bool Hit(ImVec2 point, float tolerance) const;
+    void Translate(ImVec2 delta);
 };
 
+// All shapes of an image, in the order they were made, with undo and redo.
+// Shapes live in one array per type and freeform points in one shared pool, so adding
+// a shape doesn't allocate once the arrays have grown and drawing walks memory linearly.
+// Adds, erases and moves go into a history that undo and redo step through. Erased shapes
+// keep their place in the arrays, undone ones stay until something new is done over them.
+class ShapeStore {
+public:
+    // Starts a new shape at start. Draw shows it, but it isn't counted or exported until Commit.
+    void Begin(ShapeType type, ImVec2 start, ImU32 color, float thickness, bool fill);
+    // Moves the end of the shape being made to pos, freeform strokes get pos appended instead.
+    // Freeform points closer than half the thickness to the last kept one are merged, cursors
+    // report far more of them than a stroke needs.
+    void Update(ImVec2 pos);
+    // Appends pos to the freeform stroke being made as is, for points placed on purpose
+    void AddPoint(ImVec2 pos);
+    // Adds the shape being made, dropping everything that could be redone
+    void Commit(void);
+    bool IsDrawing(void) const { return this->drawing; }
+
+    // Hides shape i, it keeps its index and undo brings it back
+    void Erase(size_t i);
+    // Starts moving shape i, UpdateMove puts it delta away from where it started
+    // and CommitMove makes all of it a single step of history
+    void BeginMove(size_t i);
+    void UpdateMove(ImVec2 delta);
+    void CommitMove(void);
+    bool IsMoving(void) const { return this->moving; }
+
+    bool Undo(void);
+    bool Redo(void);
+
+    // Number of shapes, not counting the one being made. Erased shapes are counted
+    // but have empty bounds and don't draw.
+    size_t Size(void) const { return this->live; }
+    // Draws all shapes and the one being made
+    void Draw(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    // Draws only the shape being made, if there is one
+    void DrawDraft(ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    void DrawShape(size_t i, ImDrawList *draw_list, ImVec2 offset, float scale) const;
+    BoundingBox Bounds(size_t i) const { return this->order[i].erased ? BoundingBox() : this->bounds[i]; }
+    void Rasterize(size_t i, RasterTarget *target) const;
+    // Replaces out with the shapes whose bounds overlap box, in creation order.
+    // Only the grid cells under box are visited, so the cost follows what's inside it.
+    void Query(const BoundingBox &box, std::vector<uint32_t> *out) const;
+    // Finds the topmost shape within tolerance of point. Candidates come from the grid
+    // and freeform strokes only look at the segments their tree leads to.
+    // Reuses a scratch list, so it can't run on several threads at once.
+    bool HitTest(ImVec2 point, float tolerance, size_t *index) const;
+
+private:
+    struct ShapeRef {
+        ShapeType type;
+        bool erased;
+        uint32_t index;
+    };
+
+    enum class OpType : uint8_t {
+        ADD,
+        ERASE,
+        MOVE,
+    };
+
+    struct Op {
+        OpType type;
+        uint32_t shape;
+        ImVec2 delta;
+    };
+
+    // Bounding volume hierarchy over a stroke's segments, stored depth first.
+    // Leaves cover segments [first, first + count), next is the node after the subtree,
+    // so a node is a leaf if next is the node right after it.
+    struct StrokeNode {
+        BoundingBox box;
+        uint32_t first;
+        uint32_t count;
+        uint32_t next;
+    };
+
+    // [0, applied) is done, the rest can be redone
+    std::vector<Op> history;
+    size_t applied = 0;
+
+    // Creation order, [0, live) are shown and the rest can be redone
+    std::vector<ShapeRef> order;
+    size_t live = 0;
+
+    std::vector<Line> lines;
+    std::vector<Circle> circles;
+    std::vector<Rectangle> rectangles;
+    std::vector<Freeform> freeforms;
+    std::vector<Arrow> arrows;
+    std::vector<ImVec2> points;
+    std::vector<StrokeNode> stroke_nodes;
+
+    // Bounds of every shape in order, and a uniform grid over image space listing the shapes
+    // touching each cell. Shapes spanning too many cells are kept apart in large instead.
+    // Undone shapes stay in the grid and are skipped by Query, erased ones are taken out.
+    std::vector<BoundingBox> bounds;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+    std::vector<uint32_t> large;
+    int grid_min_x = 0, grid_min_y = 0, grid_max_x = -1, grid_max_y = -1;
+    // Candidates of the last HitTest, kept so hovering doesn't allocate every frame
+    mutable std::vector<uint32_t> hit_candidates;
+
+    // Shape being made. Its points are kept apart from the pool, which may still end
+    // with points of undone strokes, and are reused by the next one.
+    bool drawing = false;
+    ShapeType draft_type;
+    ImVec2 draft_start;
+    ImVec2 draft_end;
+    ImU32 draft_color;
+    float draft_thickness;
+    bool draft_fill;
+    std::vector<ImVec2> draft_points;
+
+    // Shape being moved and how far it has gone
+    bool moving = false;
+    uint32_t move_shape;
+    ImVec2 move_delta;
+
+    BoundingBox ComputeBounds(size_t i) const;
+    void AddToGrid(uint32_t i);
+    void RemoveFromGrid(uint32_t i);
+    void BuildStrokeTree(const ImVec2 *points, uint32_t first, uint32_t count);
+    bool HitStroke(const Freeform &stroke, ImVec2 point, float tolerance) const;
+    bool Hit(size_t i, ImVec2 point, float tolerance) const;
+    void SetErased(size_t i, bool erased);
+    void Translate(size_t i, ImVec2 delta);
+    void DropRedo(void);
+};
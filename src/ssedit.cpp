@@ -1,10 +1,12 @@
 #include <vector>
 #include <memory>
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <clocale>
 #include <cmath>
 #include <fcntl.h>
+#include <getopt.h>
 #include <imgui/imgui.h>
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
@@ -15,14 +17,22 @@
 #include "utils.hpp"
 #include "decode.hpp"
 #include "encode.hpp"
+#include "search.hpp"
+#include "analyze.hpp"
+#include "export.hpp"
 #include "clibpoard.hpp"
+#include "render.hpp"
+#include "layer.hpp"
+#include "damage.hpp"
+#include "sdf.hpp"
+#include "headless.hpp"
+#include "raster.hpp"
+#include "batch.hpp"
 #include "features.hpp"
 #include "icons.hpp"
 #include "config.hpp"
 #include "log.hpp"
 
-#define STREQ(a, b) (strcmp((a), (b)) == 0)
-
 #define IMVEC4_TO_COL32(vec) (IM_COL32(vec.x * 255, vec.y * 255, vec.z * 255, vec.w * 255))
 
 enum Tool {
@@ -31,26 +41,79 @@ enum Tool {
     RECTANGLE,
     FREEFORM,
     ARROW,
+    ERASER,
+    SELECT,
 };
 
 static const char glsl_version[] = "#version 130";
+// Frames drawn after waking up before the loop blocks again, ImGui needs one more
+// frame after input for hover state and layout to catch up
+#define SETTLE_FRAMES 2
+// Redraw interval while something animates on its own, e.g. a blinking text cursor
+#define ANIMATION_INTERVAL 0.1
+// Polling interval for a GPU readback, there is no event for it finishing
+#define READBACK_POLL_INTERVAL (1.0 / 60)
+// Polling interval for wl-copy exiting, which happens some time after the copy was started
+#define REAP_POLL_INTERVAL 0.5
+// Canvas zoom limits relative to fitting the whole image, and the factor per wheel notch
+#define ZOOM_MIN 0.25f
+#define ZOOM_MAX 64.0f
+#define ZOOM_STEP 1.25f
+// How close to a shape the eraser and select tools pick it, in screen pixels
+#define HIT_TOLERANCE 4.0f
+#define HIGHLIGHT_COLOR IM_COL32(255, 255, 255, 192)
+
+ShapeStore shapes;
+// Bumped on every change to shapes, exports of the same generation look the same
+uint64_t shapes_generation = 0;
+
+// Set to copy the image to clipboard after the current frame
+static bool need_export = false;
+
+// Cursor motion between two frames, mice report far more often than frames are drawn
+struct PointerSample {
+    ImVec2 pos;
+    double time;
+};
+
+static struct {
+    std::vector<PointerSample> samples;
+    // When the left button went down and up, up is infinite while it's held
+    double press_time = 0.0;
+    double release_time = INFINITY;
+} pointer;
+
+// Wakes up the main loop from other threads
+static void WakeMainLoop(void) {
+    glfwPostEmptyEvent();
+}
+
+void CommitShape(void) {
+    shapes.Commit();
+    shapes_generation++;
+}
+
+void EraseShape(size_t i) {
+    shapes.Erase(i);
+    shapes_generation++;
+}
 
-std::vector<std::unique_ptr<Shape>> redo_list;
-std::vector<std::unique_ptr<Shape>> shapes;
+void MoveShape(ImVec2 delta) {
+    shapes.UpdateMove(delta);
+    shapes_generation++;
+}
 
 bool Undo(void) {
-    if (!shapes.empty()) {
-        redo_list.push_back(std::move(shapes.back()));
-        shapes.pop_back();
+    if (shapes.Undo()) {
+        shapes_generation++;
         return true;
     }
     return false;
 }
 
 bool Redo(void) {
-    if (!redo_list.empty()) {
-        shapes.push_back(std::move(redo_list.back()));
-        redo_list.pop_back();
+    if (shapes.Redo()) {
+        shapes_generation++;
         return true;
     }
     return false;
@@ -64,6 +127,34 @@ static void glfw_char_callback(GLFWwindow *window, uint32_t codepoint) {
     LogPrint(INFO, "GLFW char: %lc", (wchar_t)codepoint);
 }
 
+// Both are installed before the ImGui backend, which chains to them
+static void glfw_cursor_pos_callback(GLFWwindow *window, double x, double y) {
+    pointer.samples.push_back({ ImVec2(x, y), glfwGetTime() });
+}
+
+static void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    if (action == GLFW_PRESS) {
+        pointer.press_time = glfwGetTime();
+        pointer.release_time = INFINITY;
+    } else if (action == GLFW_RELEASE) {
+        pointer.release_time = glfwGetTime();
+    }
+}
+
+// Appends every position the cursor passed through with the button down since the last frame,
+// so strokes keep their shape no matter how often frames are drawn. Points closer together
+// than a fraction of the thickness are merged by the store.
+static void FeedPointerSamples(ImVec2 image_pos, float image_scale) {
+    for (const PointerSample &sample: pointer.samples) {
+        if (sample.time >= pointer.press_time && sample.time <= pointer.release_time) {
+            shapes.Update((sample.pos - image_pos) * (1.0f / image_scale));
+        }
+    }
+}
+
 static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
     if (action != GLFW_PRESS) {
         return;
@@ -74,7 +165,10 @@ static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int act
 
     switch (key) {
     case GLFW_KEY_C:
-        LogPrint(INFO, "GLFW key: Ctrl+C pressed");
+        LogPrint(INFO, "GLFW key: %sC pressed", ctrl ? "Ctrl+" : "");
+        if (ctrl) {
+            need_export = true;
+        }
         break;
     case GLFW_KEY_V:
         LogPrint(INFO, "GLFW key: Ctrl+V pressed");
@@ -90,100 +184,6 @@ static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int act
     }
 }
 
-Image *GetModifiedPixels(Image *orig_image) {
-    Image *raw_image;
-    unsigned char *pixels_buf = nullptr;
-
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // Hide window since we render offscreen
-    GLFWwindow *window2 = glfwCreateWindow(orig_image->w, orig_image->h,
-                                           "ssedit_offscr", nullptr, nullptr);
-    if (!window2) {
-        LogPrint(ERR, "Failed to create window");
-        return nullptr;
-    }
-    glfwMakeContextCurrent(window2);
-
-    // Setup second ImGui context
-    ImGuiContext *imgui_context = ImGui::CreateContext();
-    ImGui::SetCurrentContext(imgui_context);
-    ImGuiIO &io = ImGui::GetIO();
-    io.IniFilename = nullptr; // disable automatic .ini file saving
-    ImGui_ImplGlfw_InitForOpenGL(window2, true);
-    ImGui_ImplOpenGL3_Init(glsl_version);
-
-    GLuint fbo;
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-    GLuint color_tex;
-    glGenTextures(1, &color_tex);
-    glBindTexture(GL_TEXTURE_2D, color_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, orig_image->w, orig_image->h,
-                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_tex, 0);
-
-    GLuint image_tex;
-    glGenTextures(1, &image_tex);
-    glBindTexture(GL_TEXTURE_2D, image_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, orig_image->w, orig_image->h,
-                 0, GL_RGBA, GL_UNSIGNED_BYTE, orig_image->data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glViewport(0, 0, orig_image->w, orig_image->h);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
-
-    ImGui::SetNextWindowPos(ImVec2(0, 0));
-    ImGui::SetNextWindowSize(ImVec2(orig_image->w, orig_image->h));
-    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-    ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
-    ImGui::Begin("Offscreen Window", nullptr, ImGuiWindowFlags_NoMove
-                                              | ImGuiWindowFlags_NoDecoration
-                                              | ImGuiWindowFlags_NoSavedSettings);
-
-    ImGui::Image(image_tex, ImVec2(orig_image->w, orig_image->h));
-
-    ImDrawList *draw_list = ImGui::GetWindowDrawList();
-    for (const auto &shape: shapes) {
-        shape->Draw(draw_list, ImVec2(0, 0), 1);
-    }
-
-    ImGui::End();
-    ImGui::PopStyleVar();
-    ImGui::PopStyleVar();
-
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-    pixels_buf = (unsigned char *)malloc(orig_image->data_size);
-    glReadPixels(0, 0, orig_image->w, orig_image->h, GL_RGBA, GL_UNSIGNED_BYTE, pixels_buf);
-    for (uint32_t y = 0; y < orig_image->h / 2; ++y) {
-        int top_index = y * orig_image->w * 4;
-        int bottom_index = (orig_image->h - 1 - y) * orig_image->w * 4;
-        for (uint32_t x = 0; x < orig_image->w * 4; ++x) {
-            std::swap(pixels_buf[top_index + x], pixels_buf[bottom_index + x]);
-        }
-    }
-    raw_image = new Image(pixels_buf, orig_image->data_size,
-                          orig_image->w, orig_image->h, Format::RGBA);
-
-    glDeleteTextures(1, &image_tex);
-    glDeleteTextures(1, &color_tex);
-    glDeleteFramebuffers(1, &fbo);
-
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext(imgui_context);
-    glfwDestroyWindow(window2);
-
-    return raw_image;
-}
-
 bool ButtonConditional(const char *label, bool cond = true, const ImVec2 &size = ImVec2(0, 0)) {
     if (cond) {
         ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyle().Colors[ImGuiCol_ButtonActive]);
@@ -200,10 +200,23 @@ void PrintHelpAndExit(FILE *stream, int rc) {
         "ssedit - edit screenshots\n"
         "\n"
         "Usage:\n"
-        "  ssedit [OPTIONS] [IN_FILE [OUT_FILE]]\n"
+        "  ssedit [OPTIONS] [IN_FILE [OUT_FILE...]]\n"
+        "  ssedit [OPTIONS] --batch SCRIPT -o OUT_DIR IN_FILE...\n"
         "\n"
         "Options:\n"
-        "  -f FORMAT     Specify output image format\n"
+        "  -f FORMAT     Specify output image format. Pass a comma separated list\n"
+        "                like png,jxl and one OUT_FILE per format to write several\n"
+        "                formats at once, clipboard copy uses the first one.\n"
+        "                \"auto\" picks lossless for UI and lossy for photos\n"
+        "  -q QUALITY    Quality of lossy formats, 1-100 (100 is lossless for JXL)\n"
+        "  --max-bytes N Pick the best quality that fits into N bytes (K/M suffixes work)\n"
+        "  --min-ssim X  Pick the smallest output with SSIM of at least X (0-1)\n"
+        "  --headless    Don't open the editor, only export IN_FILE to OUT_FILE.\n"
+        "                Needs no display, rendering goes through EGL\n"
+        "  --cpu         Draw annotations on the CPU instead of with OpenGL on export\n"
+        "  --batch FILE  Draw the shapes described in the INI file FILE on every\n"
+        "                IN_FILE and write the results into OUT_DIR, no window is opened\n"
+        "  -o OUT_DIR    Output directory for --batch\n"
         "  -h            Display this message and exit\n"
         "  -V            Display version info and exit\n"
     ;
@@ -226,27 +239,141 @@ void PrintVersionAndExit(int rc) {
     exit(rc);
 }
 
+// Render once, then run all encoders at the same time on the shared pixels.
+// Encodes already done (or still running) for clipboard copies are reused.
+static std::vector<std::shared_ptr<const Image>> EncodeOutputs(uint64_t generation,
+                                                              std::shared_ptr<const Image> final_image,
+                                                              const std::vector<ExportSettings> &outputs) {
+    if (final_image == nullptr) {
+        return {};
+    }
+
+    return ExportImages(generation, final_image, outputs);
+}
+
+static int WriteOutputs(const std::vector<std::shared_ptr<const Image>> &encoded_images,
+                        const std::vector<ExportSettings> &outputs, const std::vector<int> &fds,
+                        const std::vector<const char *> &filenames) {
+    if (encoded_images.empty()) {
+        return 1;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < encoded_images.size(); i++) {
+        const Image *encoded_image = encoded_images[i].get();
+        if (encoded_image == nullptr
+            || !WriteToFD(fds[i], encoded_image->data, encoded_image->data_size)) {
+            LogPrint(ERR, "Failed to write %s output to %s",
+                     FormatToString(outputs[i].format), filenames[i]);
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+// Exports orig_image with the current shapes without opening a window
+static int ExportHeadless(Image *orig_image, bool cpu_render, const std::vector<ExportSettings> &outputs,
+                          const std::vector<int> &fds, const std::vector<const char *> &filenames) {
+    std::shared_ptr<const Image> final_image;
+    if (cpu_render) {
+        final_image = RenderExportCPU(orig_image, shapes);
+    } else {
+        if (!InitHeadlessRenderer(glsl_version)) {
+            delete orig_image;
+            return 1;
+        }
+        // No texture to reuse, the renderer uploads only the tiles it needs
+        final_image = RenderExport(0, orig_image, shapes);
+    }
+
+    std::vector<std::shared_ptr<const Image>> encoded_images =
+        EncodeOutputs(shapes_generation, final_image, outputs);
+    final_image.reset();
+    ClearExportCache();
+
+    if (!cpu_render) {
+        DestroyExportRenderer();
+        ShutdownHeadlessRenderer();
+    }
+    delete orig_image;
+
+    return WriteOutputs(encoded_images, outputs, fds, filenames);
+}
+
 int main(int argc, char **argv) {
     const char *input_filename = nullptr;
     int input_fd = -1;
-    const char *output_filename = nullptr;
-    int output_fd = -1;
-    Format output_format = Format::PNG; // TODO: first enabled
+    std::vector<const char *> output_filenames;
+    std::vector<int> output_fds;
+    std::vector<Format> output_formats = { Format::PNG }; // TODO: first enabled
+    EncodeParams encode_params;
+    EncodeTarget encode_target;
     const char *config_path = nullptr;
+    const char *batch_script = nullptr;
+    const char *batch_output_dir = nullptr;
+    bool headless = false;
+    bool cpu_render = false;
 
     setlocale(LC_ALL, "");
     LogInit(INFO, stderr);
 
+    enum {
+        OPT_MAX_BYTES = 256,
+        OPT_MIN_SSIM,
+        OPT_HEADLESS,
+        OPT_CPU,
+        OPT_BATCH,
+    };
+    static const struct option long_options[] = {
+        { "max-bytes", required_argument, nullptr, OPT_MAX_BYTES },
+        { "min-ssim",  required_argument, nullptr, OPT_MIN_SSIM  },
+        { "headless",  no_argument,       nullptr, OPT_HEADLESS  },
+        { "cpu",       no_argument,       nullptr, OPT_CPU       },
+        { "batch",     required_argument, nullptr, OPT_BATCH     },
+        { nullptr,     0,                 nullptr, 0             },
+    };
+
     int opt;
-    while ((opt = getopt(argc, argv, ":f:c:Vh")) != -1) {
+    while ((opt = getopt_long(argc, argv, ":f:q:c:o:Vh", long_options, nullptr)) != -1) {
         switch (opt) {
         case 'f':
-            output_format = FormatFromString(optarg);
-            if (output_format == Format::INVALID) {
+            if (!FormatListFromString(optarg, &output_formats)) {
                 LogPrint(ERR, "Invalid format: %s", optarg);
                 return 1;
             }
             break;
+        case 'q':
+            encode_params.quality = atoi(optarg);
+            if (encode_params.quality < 1 || encode_params.quality > 100) {
+                LogPrint(ERR, "Invalid quality: %s", optarg);
+                return 1;
+            }
+            break;
+        case OPT_MAX_BYTES:
+            if (!ParseSize(optarg, &encode_target.max_bytes) || encode_target.max_bytes == 0) {
+                LogPrint(ERR, "Invalid size: %s", optarg);
+                return 1;
+            }
+            break;
+        case OPT_MIN_SSIM:
+            encode_target.min_ssim = strtof(optarg, nullptr);
+            if (encode_target.min_ssim <= 0.0f || encode_target.min_ssim > 1.0f) {
+                LogPrint(ERR, "Invalid SSIM: %s", optarg);
+                return 1;
+            }
+            break;
+        case OPT_HEADLESS:
+            headless = true;
+            break;
+        case OPT_CPU:
+            cpu_render = true;
+            break;
+        case OPT_BATCH:
+            batch_script = optarg;
+            break;
+        case 'o':
+            batch_output_dir = optarg;
+            break;
         case 'c':
             config_path = optarg;
             break;
@@ -271,11 +398,39 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (batch_script != nullptr) {
+        if (batch_output_dir == nullptr) {
+            LogPrint(ERR, "--batch needs an output directory, pass it with -o");
+            return 1;
+        }
+        std::vector<const char *> batch_inputs(argv + optind, argv + argc);
+        if (batch_inputs.empty()) {
+            LogPrint(ERR, "--batch needs at least one input file");
+            return 1;
+        }
+        if (output_formats.size() > 1) {
+            LogPrint(WARN, "--batch writes one format, using %s", FormatToString(output_formats[0]));
+        }
+        return RunBatch(batch_script, batch_inputs, batch_output_dir, {
+            .format = output_formats[0],
+            .params = encode_params,
+            .target = encode_target,
+        });
+    }
+
     if (argv[optind] != nullptr) {
         input_filename = argv[optind++];
     }
-    if (argv[optind] != nullptr) {
-        output_filename = argv[optind++];
+    while (argv[optind] != nullptr) {
+        output_filenames.push_back(argv[optind++]);
+    }
+    if (output_filenames.empty() && output_formats.size() == 1) {
+        output_filenames.push_back("-");
+    }
+    if (output_filenames.size() != output_formats.size()) {
+        LogPrint(ERR, "Got %zu output formats but %zu output files",
+                 output_formats.size(), output_filenames.size());
+        return 1;
     }
 
     if (input_filename == nullptr || STREQ(input_filename, "-")) {
@@ -292,21 +447,66 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
-    if (output_filename == nullptr || STREQ(output_filename, "-")) {
-        if (isatty(STDOUT_FILENO)) {
-            LogPrint(ERR, "Output file is not specified and stdout is a TTY");
-            return 1;
+    for (const char *output_filename: output_filenames) {
+        int output_fd;
+        if (STREQ(output_filename, "-")) {
+            if (isatty(STDOUT_FILENO)) {
+                LogPrint(ERR, "Output file is not specified and stdout is a TTY");
+                return 1;
+            }
+            output_fd = STDOUT_FILENO;
+        } else {
+            output_fd = open(output_filename,
+                             O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
+                             S_IWUSR | S_IWGRP | S_IRUSR | S_IRGRP);
+            if (output_fd < 0) {
+                LogPrint(ERR, "Failed to open output file %s (%s)",
+                         output_filename, strerror(errno));
+                return 1;
+            }
         }
-        output_fd = STDOUT_FILENO;
-    } else {
-        output_fd = open(output_filename,
-                         O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
-                         S_IWUSR | S_IWGRP | S_IRUSR | S_IRGRP);
-        if (output_fd < 0) {
-            LogPrint(ERR, "Failed to open output file %s (%s)",
-                     output_filename, strerror(errno));
-            return 1;
+        output_fds.push_back(output_fd);
+    }
+
+    size_t data_size;
+    unsigned char *raw_data = ReadFromFD(input_fd, &data_size);
+    if (raw_data == NULL) {
+        return 1;
+    }
+    close(input_fd);
+
+    Image *orig_image = DecodeImage(raw_data, data_size);
+    if (orig_image == nullptr) {
+        return 1;
+    }
+    free(raw_data);
+
+    // Each output gets its own settings, so what AUTO picks (e.g. lossless quality for
+    // JXL) doesn't change the other formats
+    std::vector<ExportSettings> output_settings;
+    ExportSettings auto_settings = {
+        .format = Format::AUTO,
+        .params = encode_params,
+        .target = encode_target,
+    };
+    for (Format format: output_formats) {
+        if (format != Format::AUTO) {
+            output_settings.push_back({
+                .format = format,
+                .params = encode_params,
+                .target = encode_target,
+            });
+            continue;
+        }
+        if (auto_settings.format == Format::AUTO) {
+            auto_settings.format = ChooseAutoFormat(orig_image, &auto_settings.params);
+            LogPrint(INFO, "Picked output format %s", FormatToString(auto_settings.format));
         }
+        output_settings.push_back(auto_settings);
+    }
+
+    if (headless) {
+        return ExportHeadless(orig_image, cpu_render, output_settings, output_fds, output_filenames);
     }
 
     glfwSetErrorCallback(glfw_error_callback);
@@ -327,6 +527,8 @@ int main(int argc, char **argv) {
     }
     glfwSetCharCallback(window, glfw_char_callback);
     glfwSetKeyCallback(window, glfw_key_callback);
+    glfwSetCursorPosCallback(window, glfw_cursor_pos_callback);
+    glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1); // Enable vsync
 
@@ -342,7 +544,7 @@ int main(int argc, char **argv) {
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
-    ImGuiContext *imgui_context = ImGui::CreateContext();
+    ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
     io.IniFilename = nullptr; // disable automatic .ini file saving
     ImGuiStyle &style = ImGui::GetStyle();
@@ -352,6 +554,13 @@ int main(int argc, char **argv) {
     // Setup Platform/Renderer backends
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
+    if (ImGui_ImplOpenGL3_SetStreamingUploads(true)) {
+        LogPrint(INFO, "Render: streaming vertices through a persistently mapped ring buffer");
+    } else {
+        LogPrint(INFO, "Render: no buffer storage, uploading vertices with glBufferData");
+    }
+    InitSdfRenderer();
+    InitDamageTracking(window);
 
     // Load fonts
     ImVector<ImWchar> font_ranges;
@@ -379,31 +588,38 @@ int main(int argc, char **argv) {
     io.Fonts->AddFontFromMemoryTTF(icons_ttf_start, icons_ttf_size,
                                    19.f, &font_config, icon_ranges);
 
-    size_t data_size;
-    unsigned char *raw_data = ReadFromFD(input_fd, &data_size);
-    if (raw_data == NULL) {
-        return 1;
-    }
-    close(input_fd);
-
-    Image *orig_image = DecodeImage(raw_data, data_size);
-    if (orig_image == nullptr) {
-        return 1;
+    // Huge stitched captures don't fit into a texture, show a downscaled preview instead.
+    // Exports are rendered in tiles from the full resolution pixels either way.
+    const uint32_t max_texture_size = GetMaxTextureSize();
+    const Image *preview_image = orig_image;
+    if (orig_image->w > max_texture_size || orig_image->h > max_texture_size) {
+        uint32_t factor = (std::max(orig_image->w, orig_image->h) + max_texture_size - 1)
+                          / max_texture_size;
+        preview_image = DownscaleImage(orig_image, factor);
+        if (preview_image == nullptr) {
+            return 1;
+        }
+        LogPrint(WARN, "Image is bigger than %u pixels, showing it at 1/%u scale",
+                 max_texture_size, factor);
     }
-    free(raw_data);
 
     GLuint image_texture;
     glGenTextures(1, &image_texture);
     glBindTexture(GL_TEXTURE_2D, image_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, orig_image->w, orig_image->h,
-                 0, GL_RGBA, GL_UNSIGNED_BYTE, orig_image->data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, preview_image->w, preview_image->h,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, preview_image->data);
+    if (preview_image != orig_image) {
+        delete preview_image;
+    }
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // Main loop
-    bool need_export = false;
+    ExportSettings clipboard_settings = output_settings[0];
 
     Tool active_tool = FREEFORM;
+    // Cursor position in image space when the shape being moved was picked up
+    ImVec2 move_origin;
     const float max_thickness = std::min(orig_image->w, orig_image->h) / 2.0f;
     float thickness;
     if (config.initial_thickness < 1.f) {
@@ -414,13 +630,35 @@ int main(int argc, char **argv) {
     ImVec4 color = ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
     bool fill = false;
 
-    bool drawing_active = false;
-    ImVec2 drawing_start_pos = ImVec2(0, 0);
-    std::unique_ptr<Shape> drawing_shape = NULL;
+    // Zoom is relative to fitting the image in the canvas, pan moves it away from the center
+    float view_zoom = 1.0f;
+    ImVec2 view_pan = ImVec2(0, 0);
+    bool panning = false;
+
+    // A clipboard export is waiting for its render to be read back
+    bool export_pending = false;
+
+    // Nothing is drawn while idle, the loop blocks until there is input, a resize,
+    // an animation deadline, a wakeup from an export progressing or a wl-copy poll
+    SetExportStageCallback(WakeMainLoop);
+    int settle_frames = SETTLE_FRAMES;
+    double wait_timeout = -1.0;
 
     while (!glfwWindowShouldClose(window)) {
         // Poll and handle events (inputs, window resize, etc.)
-        glfwPollEvents();
+        pointer.samples.clear();
+        if (settle_frames > 0) {
+            settle_frames--;
+            glfwPollEvents();
+        } else {
+            if (wait_timeout < 0) {
+                glfwWaitEvents();
+            } else {
+                glfwWaitEventsTimeout(wait_timeout);
+            }
+            settle_frames = SETTLE_FRAMES - 1;
+        }
+        bool clipboard_processes_running = ReapClipboardProcesses();
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -441,17 +679,37 @@ int main(int argc, char **argv) {
 
         // Image area
         ImGui::SameLine();
-        ImGui::BeginChild("Canvas");
+        // The image can be larger than the canvas when zoomed in, it's clipped rather than scrolled
+        ImGui::BeginChild("Canvas", ImVec2(0, 0), ImGuiChildFlags_None,
+                          ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
 
         ImVec2 canvas_pos = ImGui::GetCursorScreenPos();
         ImVec2 canvas_size = ImGui::GetWindowSize();
 
+        // The wheel zooms around the cursor, dragging with the middle or right button pans
+        if (ImGui::IsWindowHovered()) {
+            if (io.MouseWheel != 0.0f) {
+                const float zoom = std::clamp(view_zoom * powf(ZOOM_STEP, io.MouseWheel), ZOOM_MIN, ZOOM_MAX);
+                // Scale the cursor's distance from the image center along with the image
+                const ImVec2 cursor = io.MousePos - canvas_pos - canvas_size * 0.5f;
+                view_pan = cursor - (cursor - view_pan) * (zoom / view_zoom);
+                view_zoom = zoom;
+            }
+            if (ImGui::IsMouseClicked(ImGuiMouseButton_Middle) || ImGui::IsMouseClicked(ImGuiMouseButton_Right)) {
+                panning = true;
+            }
+        }
+        if (panning) {
+            view_pan += io.MouseDelta;
+            panning = ImGui::IsMouseDown(ImGuiMouseButton_Middle) || ImGui::IsMouseDown(ImGuiMouseButton_Right);
+        }
+
         // Compute scale to fit image while preserving aspect ratio
-        float image_scale = std::min(canvas_size.x / orig_image->w, canvas_size.y / orig_image->h);
+        float image_scale = std::min(canvas_size.x / orig_image->w, canvas_size.y / orig_image->h) * view_zoom;
         ImVec2 image_size = ImVec2(orig_image->w * image_scale, orig_image->h * image_scale);
 
         // Center the image inside the canvas region
-        ImVec2 image_offset = (canvas_size - image_size) * 0.5f;
+        ImVec2 image_offset = (canvas_size - image_size) * 0.5f + view_pan;
         ImVec2 image_pos = canvas_pos + image_offset;
 
         ImGui::SetCursorScreenPos(image_pos);
@@ -459,11 +717,21 @@ int main(int argc, char **argv) {
 
         ImDrawList *canvas_draw_list = ImGui::GetWindowDrawList();
 
-        for (const auto &shape: shapes) {
-            shape->Draw(canvas_draw_list, image_pos, image_scale);
+        // Committed shapes come from the cached layer, only the one being drawn is tessellated.
+        // The layer's quad stays the same when it's redrawn, so its damage has to be added.
+        if (DrawShapeLayer(canvas_draw_list, shapes, shapes_generation,
+                           canvas_pos, canvas_size, image_offset, image_scale)) {
+            AddDamage(canvas_pos, canvas_pos + canvas_size);
         }
-        if (drawing_shape) {
-            drawing_shape->Draw(canvas_draw_list, image_pos, image_scale);
+        shapes.DrawDraft(canvas_draw_list, image_pos, image_scale);
+
+        // A moved shape follows the cursor until the button is let go, even outside the image
+        if (shapes.IsMoving()) {
+            if (!ImGui::IsMouseDown(0)) {
+                shapes.CommitMove();
+            } else if (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f) {
+                MoveShape((io.MousePos - image_pos) * (1.0f / image_scale) - move_origin);
+            }
         }
 
         if (ImGui::IsItemHovered()) {
@@ -471,47 +739,61 @@ int main(int argc, char **argv) {
             ImVec2 mouse_pos = ImGui::GetIO().MousePos;
             ImVec2 local_mouse_pos = (mouse_pos - image_pos) * (1.0f / image_scale);
 
-            if (ImGui::IsMouseClicked(0) && !drawing_active) {
-                drawing_active = true;
-                drawing_start_pos = local_mouse_pos;
-
+            if (active_tool == ERASER || active_tool == SELECT) {
+                // The eraser takes the shapes it's clicked or dragged over, one at a time so holding
+                // still doesn't eat a whole stack. Select picks up the shape under the cursor.
+                size_t hovered;
+                if (!shapes.IsMoving()
+                    && shapes.HitTest(local_mouse_pos, HIT_TOLERANCE / image_scale, &hovered)) {
+                    const bool moved = io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f;
+                    if (active_tool == ERASER
+                        && (ImGui::IsMouseClicked(0) || (ImGui::IsMouseDown(0) && moved))) {
+                        EraseShape(hovered);
+                    } else if (active_tool == SELECT && ImGui::IsMouseClicked(0)) {
+                        shapes.BeginMove(hovered);
+                        move_origin = local_mouse_pos;
+                    } else {
+                        BoundingBox box = shapes.Bounds(hovered);
+                        canvas_draw_list->AddRect(image_pos + box.min * image_scale,
+                                                  image_pos + box.max * image_scale, HIGHLIGHT_COLOR);
+                    }
+                }
+            } else if (ImGui::IsMouseClicked(0) && !shapes.IsDrawing()) {
+                ShapeType type = ShapeType::FREEFORM;
                 switch (active_tool) {
                 case LINE:
-                    drawing_shape = std::make_unique<Line>(drawing_start_pos,
-                                                           IMVEC4_TO_COL32(color),
-                                                           thickness);
+                    type = ShapeType::LINE;
                     break;
                 case CIRCLE:
-                    drawing_shape = std::make_unique<Circle>(drawing_start_pos,
-                                                             IMVEC4_TO_COL32(color),
-                                                             thickness, fill);
+                    type = ShapeType::CIRCLE;
                     break;
                 case RECTANGLE:
-                    drawing_shape = std::make_unique<Rectangle>(drawing_start_pos,
-                                                                IMVEC4_TO_COL32(color),
-                                                                thickness, fill);
+                    type = ShapeType::RECTANGLE;
                     break;
                 case FREEFORM:
-                    drawing_shape = std::make_unique<Freeform>(drawing_start_pos,
-                                                               IMVEC4_TO_COL32(color),
-                                                               thickness);
+                    type = ShapeType::FREEFORM;
                     break;
                 case ARROW:
-                    drawing_shape = std::make_unique<Arrow>(drawing_start_pos,
-                                                            IMVEC4_TO_COL32(color),
-                                                            thickness);
+                    type = ShapeType::ARROW;
                     break;
+                case ERASER:
+                case SELECT:
+                    break;
+                }
+                shapes.Begin(type, local_mouse_pos, IMVEC4_TO_COL32(color), thickness, fill);
+                if (type == ShapeType::FREEFORM) {
+                    FeedPointerSamples(image_pos, image_scale);
+                }
+            } else if (shapes.IsDrawing()) {
+                // Other shapes only need to know where they end
+                if (active_tool == FREEFORM) {
+                    FeedPointerSamples(image_pos, image_scale);
+                } else {
+                    shapes.Update(local_mouse_pos);
                 }
-            } else if (drawing_active) {
-                drawing_shape->Update(local_mouse_pos);
 
                 if (ImGui::IsMouseReleased(0)) {
-                    shapes.push_back(std::move(drawing_shape));
-                    redo_list.clear();
-
-                    drawing_shape.reset();
-                    drawing_active = false;
-                    drawing_start_pos = ImVec2(0, 0);
+                    CommitShape();
                 }
             }
         }
@@ -530,7 +812,7 @@ int main(int argc, char **argv) {
         ImGui::SetNextItemWidth(-1);
         ImGui::SliderFloat("##Thickness", &thickness, 1.0f, max_thickness);
         if (ImGui::IsItemActive()) {
-            canvas_draw_list->AddCircleFilled(image_pos + image_size / 2,
+            canvas_draw_list->AddCircleFilled(canvas_pos + canvas_size / 2,
                                               thickness * image_scale / 2,
                                               IMVEC4_TO_COL32(color));
         }
@@ -559,9 +841,22 @@ int main(int argc, char **argv) {
         if (ButtonConditional(ICON_ARROW_RIGHT, active_tool == ARROW, ImVec2(button_width, 0))) {
             active_tool = ARROW;
         }
+        if (ButtonConditional(ICON_ERASER, active_tool == ERASER, ImVec2(button_width, 0))) {
+            active_tool = ERASER;
+        }
+        ImGui::SameLine();
+        if (ButtonConditional(ICON_ARROW_POINTER, active_tool == SELECT, ImVec2(button_width, 0))) {
+            active_tool = SELECT;
+        }
 
         ImGui::Checkbox("Fill", &fill);
 
+        ImGui::Text("Zoom %.0f%%", view_zoom * 100.0f);
+        if (ImGui::Button("Fit", ImVec2(-1, 0))) {
+            view_zoom = 1.0f;
+            view_pan = ImVec2(0, 0);
+        }
+
         available_width = ImGui::GetContentRegionAvail().x;
         button_count = 3.0f;
         spacing = ImGui::GetStyle().ItemSpacing.x;
@@ -584,42 +879,96 @@ int main(int argc, char **argv) {
         if (ImGui::Button(ICON_COPY, ImVec2(available_width, 0))) {
             need_export = true;
         }
+        ExportStage export_stage = GetClipboardExportStage();
+        if (export_stage != ExportStage::IDLE) {
+            float progress;
+            switch (export_stage) {
+            case ExportStage::ENCODING:   progress = 0.33f; break;
+            case ExportStage::OPTIMIZING: progress = 0.66f; break;
+            default:                      progress = 1.0f;  break;
+            }
+            ImGui::ProgressBar(progress, ImVec2(-1, 0), ExportStageToString(export_stage));
+        }
 
         ImGui::EndChild();
         // Leave control panel context
 
         ImGui::End();
 
+        wait_timeout = -1.0;
+        if (io.WantTextInput) {
+            wait_timeout = ANIMATION_INTERVAL;
+        }
+
         // Rendering
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (PrepareDamagedFrame(ImGui::GetDrawData())) {
+            SdfRenderDrawData(ImGui::GetDrawData());
+            PresentFrame(window);
+        }
 
-        glfwSwapBuffers(window);
+        ReleaseExportBuffers();
 
         if (need_export) {
             need_export = false;
 
-            Image *raw_image = GetModifiedPixels(orig_image);
-
-            Image *encoded_image = EncodeImage(raw_image, output_format);
-            delete raw_image;
-
-            if (encoded_image != nullptr) {
-                CopyToClipboard(encoded_image);
+            // Nothing changed since the last export, skip rendering and possibly encoding too
+            std::shared_ptr<const Image> raw_image = GetCachedRender(shapes_generation);
+            if (raw_image == nullptr && cpu_render) {
+                raw_image = RenderExportCPU(orig_image, shapes);
+                if (raw_image != nullptr) {
+                    CacheRender(shapes_generation, raw_image);
+                }
+            }
+            if (raw_image != nullptr) {
+                StartClipboardExport(shapes_generation, raw_image, clipboard_settings);
+            } else if (!cpu_render) {
+                export_pending = QueueExportRender(image_texture, orig_image, shapes,
+                                                   shapes_generation);
             }
-            delete encoded_image;
-
-            glfwMakeContextCurrent(window);
-            ImGui::SetCurrentContext(imgui_context);
+        }
+        if (export_pending) {
+            // Readback was started on an earlier frame and is most likely done by now
+            uint64_t generation;
+            std::shared_ptr<const Image> raw_image = CollectExportRender(&generation, false);
+            if (raw_image != nullptr) {
+                export_pending = false;
+                CacheRender(generation, raw_image);
+                StartClipboardExport(generation, raw_image, clipboard_settings);
+            }
+        }
+        if (export_pending) {
+            wait_timeout = READBACK_POLL_INTERVAL;
+        } else if (clipboard_processes_running && wait_timeout < 0) {
+            wait_timeout = REAP_POLL_INTERVAL;
+        }
+    }
+    SetExportStageCallback(nullptr);
+
+    // Encoding reads straight from the GL readback buffer, so the context has to stay
+    // around until it's done. Hide the window meanwhile, as far as the user is concerned
+    // the editor is closed.
+    glfwHideWindow(window);
+
+    std::shared_ptr<const Image> final_image = GetCachedRender(shapes_generation);
+    if (final_image == nullptr) {
+        if (cpu_render) {
+            final_image = RenderExportCPU(orig_image, shapes);
+        } else {
+            final_image = RenderExport(image_texture, orig_image, shapes);
         }
     }
-
-    Image *final_image = GetModifiedPixels(orig_image);
     delete orig_image;
 
+    std::vector<std::shared_ptr<const Image>> encoded_final_images =
+        EncodeOutputs(shapes_generation, final_image, output_settings);
+    final_image.reset();
+    ClearExportCache();
+
     // Cleanup
-    glfwMakeContextCurrent(window);
-    ImGui::SetCurrentContext(imgui_context);
+    DestroyShapeLayer();
+    DestroyExportRenderer();
+    ShutdownSdfRenderer();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -631,14 +980,6 @@ int main(int argc, char **argv) {
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    Image *encoded_final_image = EncodeImage(final_image, output_format);
-    delete final_image;
-
-    if (encoded_final_image != nullptr) {
-        WriteToFD(output_fd, encoded_final_image->data, encoded_final_image->data_size);
-    }
-    delete encoded_final_image;
-
-    return 0;
+    return WriteOutputs(encoded_final_images, output_settings, output_fds, output_filenames);
 }
 
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <imgui/imgui_internal.h>
+
+#include "tessellate.hpp"
+#include "threadpool.hpp"
+
+// Fewer shapes than this aren't worth handing to another thread
+#define MIN_SHAPES_PER_CHUNK 64
+
+// Font UVs, tessellation tolerance and flags can change every frame,
+// everything but the scratch buffer is taken from the context
+static void CopySharedData(ImDrawListSharedData *dst, const ImDrawListSharedData *src) {
+    dst->TexUvWhitePixel = src->TexUvWhitePixel;
+    dst->TexUvLines = src->TexUvLines;
+    dst->Font = src->Font;
+    dst->FontSize = src->FontSize;
+    dst->FontScale = src->FontScale;
+    dst->CurveTessellationTol = src->CurveTessellationTol;
+    dst->InitialFringeScale = src->InitialFringeScale;
+    dst->InitialFlags = src->InitialFlags;
+    dst->ClipRectFullscreen = src->ClipRectFullscreen;
+    dst->SetCircleTessellationMaxError(src->CircleSegmentMaxError);
+}
+
+void TessellateShapes(ShapeDrawLists *out, const ShapeStore &shapes, ImVec2 offset, float scale,
+                      ImVec4 clip_rect, const BoundingBox *cull) {
+    // With a cull box only the shapes the grid finds in it are walked
+    if (cull != nullptr) {
+        shapes.Query(*cull, &out->visible);
+    }
+    const size_t n = cull != nullptr ? out->visible.size() : shapes.Size();
+    const size_t max_chunks = GetThreadPool().ThreadCount() + 1;
+    const size_t chunk_size = std::max<size_t>((n + max_chunks - 1) / max_chunks, MIN_SHAPES_PER_CHUNK);
+    const size_t chunks = std::max<size_t>((n + chunk_size - 1) / chunk_size, 1);
+
+    // Lists are created here, ImGui isn't thread safe enough for that to happen on workers
+    while (out->lists.size() < chunks) {
+        out->shared.push_back(IM_NEW(ImDrawListSharedData)());
+        out->lists.push_back(IM_NEW(ImDrawList)(out->shared.back()));
+    }
+    out->used = chunks;
+
+    for (size_t c = 0; c < chunks; c++) {
+        CopySharedData(out->shared[c], ImGui::GetDrawListSharedData());
+    }
+
+    // The current context is thread local (see imconfig.h), so workers run without one and
+    // draw lists only use the shared data they were created with
+    const ImTextureID font_texture = ImGui::GetIO().Fonts->TexID;
+    ParallelFor(chunks, [&](size_t c) {
+        ImDrawList *draw_list = out->lists[c];
+        draw_list->_ResetForNewFrame();
+        draw_list->PushClipRect(ImVec2(clip_rect.x, clip_rect.y), ImVec2(clip_rect.z, clip_rect.w));
+        draw_list->PushTextureID(font_texture);
+
+        const size_t end = std::min(n, (c + 1) * chunk_size);
+        for (size_t i = c * chunk_size; i < end; i++) {
+            shapes.DrawShape(cull != nullptr ? out->visible[i] : i, draw_list, offset, scale);
+        }
+    });
+}
+
+void AddShapeDrawLists(ImDrawData *draw_data, ShapeDrawLists *lists) {
+    for (size_t i = 0; i < lists->used; i++) {
+        ImDrawList *draw_list = lists->lists[i];
+        // Skip chunks that had nothing in view
+        if (draw_list->VtxBuffer.Size > 0 || draw_list->CmdBuffer.Size > 1) {
+            draw_data->AddDrawList(draw_list);
+        }
+    }
+}
+
+void DestroyShapeDrawLists(ShapeDrawLists *lists) {
+    for (ImDrawList *draw_list: lists->lists) {
+        IM_DELETE(draw_list);
+    }
+    for (ImDrawListSharedData *shared: lists->shared) {
+        IM_DELETE(shared);
+    }
+    lists->lists.clear();
+    lists->shared.clear();
+    lists->used = 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <imgui/imgui.h>
+
+#include "shapes.hpp"
+
+// Draw lists that shapes are tessellated into, one per chunk of shapes.
+// Kept between calls so their buffers are reused.
+struct ShapeDrawLists {
+    std::vector<ImDrawList *> lists;
+    // Shared data of each list. Draw lists tessellate into its scratch buffer,
+    // so lists filled on different threads can't share the context's one.
+    std::vector<ImDrawListSharedData *> shared;
+    size_t used = 0;
+    // Shapes found in the cull box
+    std::vector<uint32_t> visible;
+};
+
+// Tessellates shapes in chunks on the thread pool, each chunk into its own draw list.
+// Lists are clipped to clip_rect and in shape order, so adding them to draw data one
+// after another draws the same as a single list would. Shapes whose bounds don't overlap
+// cull, a box in image space, aren't visited at all. Pass nullptr to draw everything.
+void TessellateShapes(ShapeDrawLists *out, const ShapeStore &shapes, ImVec2 offset, float scale,
+                      ImVec4 clip_rect, const BoundingBox *cull);
+
+// Appends the lists filled by the last TessellateShapes call
+void AddShapeDrawLists(ImDrawData *draw_data, ShapeDrawLists *lists);
+
+void DestroyShapeDrawLists(ShapeDrawLists *lists);
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <atomic>
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(unsigned int n_threads) {
+    n_threads = std::max(n_threads, 1u);
+    for (unsigned int i = 0; i < n_threads; i++) {
+        this->threads.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->cond.notify_all();
+
+    for (auto &thread: this->threads) {
+        thread.join();
+    }
+}
+
+unsigned int ThreadPool::ThreadCount(void) const {
+    return this->threads.size();
+}
+
+void ThreadPool::Enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->tasks.push(std::move(task));
+    }
+    this->cond.notify_one();
+}
+
+void ThreadPool::WorkerLoop(void) {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+            if (this->stopping && this->tasks.empty()) {
+                return;
+            }
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+        }
+        task();
+    }
+}
+
+ThreadPool &GetThreadPool(void) {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+void ParallelFor(size_t n, const std::function<void(size_t)> &func) {
+    struct State {
+        std::atomic<size_t> next = 0;
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+    if (n == 0) {
+        return;
+    }
+    auto state = std::make_shared<State>();
+
+    // Helpers that start after all items were claimed exit without touching func,
+    // so it's fine for them to outlive this call
+    auto work = [state, n, &func]() {
+        size_t i;
+        while ((i = state->next++) < n) {
+            func(i);
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (++state->done == n) {
+                state->cond.notify_all();
+            }
+        }
+    };
+
+    ThreadPool &pool = GetThreadPool();
+    size_t helpers = std::min<size_t>(n, pool.ThreadCount() + 1) - 1;
+    for (size_t i = 0; i < helpers; i++) {
+        pool.Submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cond.wait(lock, [&state, n]() { return state->done == n; });
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+    ThreadPool(unsigned int n_threads);
+    ~ThreadPool();
+
+    template<typename F>
+    auto Submit(F &&func) -> std::future<std::invoke_result_t<F>> {
+        using R = std::invoke_result_t<F>;
+
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+        std::future<R> future = task->get_future();
+        Enqueue([task]() { (*task)(); });
+
+        return future;
+    }
+
+    unsigned int ThreadCount(void) const;
+
+private:
+    void Enqueue(std::function<void()> task);
+    void WorkerLoop(void);
+
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping = false;
+};
+
+ThreadPool &GetThreadPool(void);
+
+// Calls func(i) for every i in [0, n) on the pool and waits for all calls to finish.
+// The calling thread works on items too, so nested calls from pool workers can't deadlock.
+void ParallelFor(size_t n, const std::function<void(size_t)> &func);
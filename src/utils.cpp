@@ -2,6 +2,8 @@
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
+#include <cctype>
+#include <cstdint>
 #include <unistd.h>
 
 #include "log.hpp"
@@ -66,3 +68,31 @@ bool WriteToFD(int fd, const unsigned char *buf, size_t buf_size) {
     return true;
 }
 
+// Parses sizes like 500000, 800K or 10M
+bool ParseSize(const char *str, size_t *size) {
+    char *endptr;
+    int shift = 0;
+
+    // strtoull() takes "-1" and wraps it around to the largest value
+    if (!isdigit((unsigned char)str[0])) {
+        return false;
+    }
+    errno = 0;
+    unsigned long long value = strtoull(str, &endptr, 10);
+    if (errno != 0 || endptr == str) {
+        return false;
+    }
+
+    switch (*endptr) {
+    case 'K': case 'k': shift = 10; endptr++; break;
+    case 'M': case 'm': shift = 20; endptr++; break;
+    case 'G': case 'g': shift = 30; endptr++; break;
+    }
+    if (*endptr != '\0' || value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    value <<= shift;
+
+    *size = value;
+    return true;
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
+
+#define STREQ(a, b) (strcmp((a), (b)) == 0)
 
 unsigned char *ReadFromFD(int fd, size_t *size);
 
 bool WriteToFD(int fd, const unsigned char *buf, size_t buf_size);
 
+// Parses sizes like 500000, 800K or 10M, fails on signs and sizes that don't fit into size_t
+bool ParseSize(const char *str, size_t *size);
+
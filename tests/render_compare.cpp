@@ -0,0 +1,154 @@
+// Renders a fixed set of shapes through the CPU rasterizer and the headless GL renderer
+// and compares the two. Exits with 77 (skipped) when there is no EGL device.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <memory>
+
+#include "shapes.hpp"
+#include "raster.hpp"
+#include "render.hpp"
+#include "headless.hpp"
+#include "sdf.hpp"
+#include "log.hpp"
+
+#define WIDTH 400
+#define HEIGHT 300
+#define EXIT_SKIP 77
+
+// Pixels whose 3x3 neighbourhood is a single color in both renders, the background and
+// the inside of shapes, may only differ by blending rounding
+#define INTERIOR_TOLERANCE 2
+// Antialiased outlines are compared looser, by their largest difference and by how many
+// pixels are off by more than EDGE_SOFT_TOLERANCE. A missing fringe or an outline in the
+// wrong place shows up all around a shape.
+#define EDGE_SOFT_TOLERANCE 32
+
+struct EdgeLimits {
+    int tolerance;
+    size_t max_mismatches;
+};
+// ImDrawList cuts line ends off where the rasterizer fades them out over a pixel, so a few
+// pixels are off by half of the contrast there
+static const EdgeLimits TESSELLATED_LIMITS = { 128, 160 };
+// Instanced shapes are shaded per pixel the way the rasterizer covers them
+static const EdgeLimits SDF_LIMITS = { 64, 16 };
+
+static void AddShape(ShapeStore *shapes, ShapeType type, ImVec2 start, ImVec2 end,
+                     ImU32 color, float thickness, bool fill) {
+    shapes->Begin(type, start, color, thickness, fill);
+    shapes->Update(end);
+    shapes->Commit();
+}
+
+static void AddShapes(ShapeStore *shapes) {
+    AddShape(shapes, ShapeType::LINE, ImVec2(10, 10), ImVec2(150, 80), IM_COL32(255, 0, 0, 255), 6, false);
+    AddShape(shapes, ShapeType::CIRCLE, ImVec2(220, 60), ImVec2(260, 60), IM_COL32(0, 0, 255, 255), 4, false);
+    AddShape(shapes, ShapeType::CIRCLE, ImVec2(330, 60), ImVec2(350, 60), IM_COL32(0, 100, 255, 160), 4, true);
+    AddShape(shapes, ShapeType::RECTANGLE, ImVec2(20, 120), ImVec2(120, 180), IM_COL32(0, 150, 0, 255), 5, false);
+    AddShape(shapes, ShapeType::RECTANGLE, ImVec2(130, 120), ImVec2(170, 190), IM_COL32(0, 150, 0, 128), 5, true);
+    AddShape(shapes, ShapeType::ARROW, ImVec2(200, 280), ImVec2(280, 150), IM_COL32(200, 0, 200, 255), 4, false);
+
+    shapes->Begin(ShapeType::FREEFORM, ImVec2(300, 150), IM_COL32(0, 0, 0, 255), 3, false);
+    for (int i = 1; i < 60; i++) {
+        shapes->Update(ImVec2(300 + i * 1.5f, 150 + 30 * sinf(i * 0.15f)));
+    }
+    shapes->Commit();
+    shapes->Begin(ShapeType::FREEFORM, ImVec2(50, 250), IM_COL32(0, 0, 0, 200), 5, false);
+    shapes->Update(ImVec2(100, 200));
+    shapes->Update(ImVec2(150, 250));
+    shapes->Update(ImVec2(120, 280));
+    shapes->Commit();
+}
+
+static const unsigned char *Pixel(const Image *image, int x, int y) {
+    x = std::clamp(x, 0, WIDTH - 1);
+    y = std::clamp(y, 0, HEIGHT - 1);
+    return image->data + ((size_t)y * WIDTH + x) * 4;
+}
+
+static bool IsEdge(const Image *image, int x, int y) {
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (memcmp(Pixel(image, x, y), Pixel(image, x + dx, y + dy), 4) != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool Compare(const Image *cpu, const Image *gl, const EdgeLimits &limits) {
+    int worst_interior = 0, worst_interior_x = 0, worst_interior_y = 0;
+    int worst_edge = 0, worst_edge_x = 0, worst_edge_y = 0;
+    size_t edges = 0, edge_mismatches = 0;
+
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            int diff = 0;
+            for (int c = 0; c < 4; c++) {
+                diff = std::max(diff, abs(Pixel(cpu, x, y)[c] - Pixel(gl, x, y)[c]));
+            }
+
+            if (IsEdge(cpu, x, y) || IsEdge(gl, x, y)) {
+                edges++;
+                edge_mismatches += diff > EDGE_SOFT_TOLERANCE;
+                if (diff > worst_edge) {
+                    worst_edge = diff;
+                    worst_edge_x = x;
+                    worst_edge_y = y;
+                }
+            } else if (diff > worst_interior) {
+                worst_interior = diff;
+                worst_interior_x = x;
+                worst_interior_y = y;
+            }
+        }
+    }
+
+    printf("interior: largest difference %d at %d,%d (at most %d)\n",
+           worst_interior, worst_interior_x, worst_interior_y, INTERIOR_TOLERANCE);
+    printf("edges: largest difference %d at %d,%d (at most %d), %zu of %zu over %d (at most %zu)\n",
+           worst_edge, worst_edge_x, worst_edge_y, limits.tolerance,
+           edge_mismatches, edges, EDGE_SOFT_TOLERANCE, limits.max_mismatches);
+    return worst_interior <= INTERIOR_TOLERANCE && worst_edge <= limits.tolerance
+           && edge_mismatches <= limits.max_mismatches;
+}
+
+int main(void) {
+    LogInit(WARN, stderr);
+
+    unsigned char *pixels = (unsigned char *)malloc(WIDTH * HEIGHT * 4);
+    for (size_t i = 0; i < WIDTH * HEIGHT; i++) {
+        pixels[i * 4 + 0] = 230;
+        pixels[i * 4 + 1] = 230;
+        pixels[i * 4 + 2] = 230;
+        pixels[i * 4 + 3] = 255;
+    }
+    Image image(pixels, WIDTH * HEIGHT * 4, WIDTH, HEIGHT, Format::RGBA);
+
+    ShapeStore shapes;
+    AddShapes(&shapes);
+
+    if (!InitHeadlessRenderer("#version 130")) {
+        printf("no EGL device, skipping\n");
+        return EXIT_SKIP;
+    }
+
+    int rc = EXIT_FAILURE;
+    std::shared_ptr<const Image> cpu = RenderExportCPU(&image, shapes);
+    std::shared_ptr<const Image> gl = RenderExport(0, &image, shapes);
+    if (cpu == nullptr || gl == nullptr) {
+        printf("render failed\n");
+    } else if (Compare(cpu.get(), gl.get(), SdfEnabled() ? SDF_LIMITS : TESSELLATED_LIMITS)) {
+        rc = EXIT_SUCCESS;
+    }
+
+    cpu.reset();
+    gl.reset();
+    DestroyExportRenderer();
+    ShutdownHeadlessRenderer();
+    return rc;
+}
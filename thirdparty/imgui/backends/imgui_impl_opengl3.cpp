@@ -22,6 +22,7 @@
 
 // CHANGELOG
 // (minor and older changes stripped away, please see git history for details)
+//  [ssedit] OpenGL: Optional streaming uploads through a persistently mapped, fenced ring buffer (GL 4.4+). Added ImGui_ImplOpenGL3_SetStreamingUploads(), ImGui_ImplOpenGL3_GetUploadStats().
 //  2025-02-18: OpenGL: Lazily reinitialize embedded GL loader for when calling backend from e.g. other DLL boundaries. (#8406)
 //  2024-10-07: OpenGL: Changed default texture sampler to Clamp instead of Repeat/Wrap.
 //  2024-06-28: OpenGL: ImGui_ImplOpenGL3_NewFrame() recreates font texture if it has been destroyed by ImGui_ImplOpenGL3_DestroyFontsTexture(). (#7748)
@@ -212,6 +213,15 @@
 #define IMGUI_IMPL_OPENGL_MAY_HAVE_BIND_SAMPLER
 #endif
 
+// Desktop GL 4.4+ has glBufferStorage() for persistently mapped buffers, also needs fences and glDrawElementsBaseVertex() from 3.2
+#if defined(IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET) && defined(GL_VERSION_4_4)
+#define IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+#endif
+
+// Streaming ring: segments written in turn, each fenced before it is written again
+#define IMGUI_IMPL_OPENGL_STREAM_SEGMENTS           3
+#define IMGUI_IMPL_OPENGL_STREAM_MIN_VERTICES       65536
+
 // [Debugging]
 //#define IMGUI_IMPL_OPENGL_DEBUG
 #ifdef IMGUI_IMPL_OPENGL_DEBUG
@@ -243,6 +253,22 @@ struct ImGui_ImplOpenGL3_Data
     bool            HasPolygonMode;
     bool            HasClipOrigin;
     bool            UseBufferSubData;
+    bool            HasBufferStorage;
+
+    // Streaming uploads, active while StreamVboHandle != 0
+    bool            UseStreamingUploads;
+    GLuint          StreamVboHandle, StreamElementsHandle;
+    char*           StreamVtxMapped;
+    char*           StreamIdxMapped;
+    int             StreamVtxCapacity;       // Vertices/indices per segment
+    int             StreamIdxCapacity;
+    int             StreamSegment;
+    int             StreamVtxUsed;           // Vertices/indices written to the current segment
+    int             StreamIdxUsed;
+    void*           StreamFences[IMGUI_IMPL_OPENGL_STREAM_SEGMENTS]; // GLsync
+    ImVector<GLint> StreamVtxBase;           // Per draw list of the draw data being rendered
+    ImVector<GLintptr> StreamIdxBase;
+    ImGui_ImplOpenGL3_UploadStats Stats;
 
     ImGui_ImplOpenGL3_Data() { memset((void*)this, 0, sizeof(*this)); }
 };
@@ -394,8 +420,18 @@ bool    ImGui_ImplOpenGL3_Init(const char* glsl_version)
         const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
         if (extension != nullptr && strcmp(extension, "GL_ARB_clip_control") == 0)
             bd->HasClipOrigin = true;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+        if (extension != nullptr && strcmp(extension, "GL_ARB_buffer_storage") == 0 && bd->GlVersion >= 320)
+            bd->HasBufferStorage = true;
+#endif
     }
 #endif
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+    if (bd->GlVersion >= 440)
+        bd->HasBufferStorage = true;
+    if (glBufferStorage == nullptr || glMapBufferRange == nullptr || glFenceSync == nullptr)
+        bd->HasBufferStorage = false;
+#endif
 
     return true;
 }
@@ -413,6 +449,141 @@ void    ImGui_ImplOpenGL3_Shutdown()
     IM_DELETE(bd);
 }
 
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+static void ImGui_ImplOpenGL3_DestroyStreamBuffers(ImGui_ImplOpenGL3_Data* bd)
+{
+    // Buffers and fences may still be in use by the GPU, GL keeps them alive until it's done
+    for (void*& fence : bd->StreamFences)
+        if (fence != nullptr) { glDeleteSync((GLsync)fence); fence = nullptr; }
+    if (bd->StreamVboHandle)      { glDeleteBuffers(1, &bd->StreamVboHandle); bd->StreamVboHandle = 0; }
+    if (bd->StreamElementsHandle) { glDeleteBuffers(1, &bd->StreamElementsHandle); bd->StreamElementsHandle = 0; }
+    bd->StreamVtxMapped = bd->StreamIdxMapped = nullptr;
+    bd->StreamVtxCapacity = bd->StreamIdxCapacity = 0;
+    bd->StreamSegment = bd->StreamVtxUsed = bd->StreamIdxUsed = 0;
+}
+
+static char* ImGui_ImplOpenGL3_CreateMappedBuffer(GLuint* handle, GLsizeiptr size)
+{
+    // Any target will do to create the storage, GL_ARRAY_BUFFER doesn't touch the bound VAO
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+    glGenBuffers(1, handle);
+    glBindBuffer(GL_ARRAY_BUFFER, *handle);
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    char* mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)last_array_buffer);
+    return mapped;
+}
+
+static bool ImGui_ImplOpenGL3_CreateStreamBuffers(ImGui_ImplOpenGL3_Data* bd, int vtx_capacity, int idx_capacity)
+{
+    ImGui_ImplOpenGL3_DestroyStreamBuffers(bd);
+    bd->StreamVtxMapped = ImGui_ImplOpenGL3_CreateMappedBuffer(&bd->StreamVboHandle, (GLsizeiptr)vtx_capacity * IMGUI_IMPL_OPENGL_STREAM_SEGMENTS * sizeof(ImDrawVert));
+    bd->StreamIdxMapped = ImGui_ImplOpenGL3_CreateMappedBuffer(&bd->StreamElementsHandle, (GLsizeiptr)idx_capacity * IMGUI_IMPL_OPENGL_STREAM_SEGMENTS * sizeof(ImDrawIdx));
+    bd->Stats.Respecifications += 2;
+    if (bd->StreamVtxMapped == nullptr || bd->StreamIdxMapped == nullptr)
+    {
+        fprintf(stderr, "Failed to map streaming buffers, falling back to glBufferData()\n");
+        ImGui_ImplOpenGL3_DestroyStreamBuffers(bd);
+        bd->UseStreamingUploads = false;
+        return false;
+    }
+    bd->StreamVtxCapacity = vtx_capacity;
+    bd->StreamIdxCapacity = idx_capacity;
+    return true;
+}
+
+// Fences the segment being written and moves to the next one, waiting for the GPU to finish with it
+static void ImGui_ImplOpenGL3_AdvanceStreamSegment(ImGui_ImplOpenGL3_Data* bd)
+{
+    void*& done = bd->StreamFences[bd->StreamSegment];
+    if (done != nullptr)
+        glDeleteSync((GLsync)done);
+    done = (void*)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    bd->StreamSegment = (bd->StreamSegment + 1) % IMGUI_IMPL_OPENGL_STREAM_SEGMENTS;
+    bd->StreamVtxUsed = bd->StreamIdxUsed = 0;
+    void*& next = bd->StreamFences[bd->StreamSegment];
+    if (next == nullptr)
+        return;
+    GLenum status = glClientWaitSync((GLsync)next, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        bd->Stats.FenceWaits++;
+        do
+            status = glClientWaitSync((GLsync)next, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync((GLsync)next);
+    next = nullptr;
+}
+
+// Copies all vertices and indices of draw_data into the ring, fills StreamVtxBase/StreamIdxBase
+static bool ImGui_ImplOpenGL3_StreamDrawData(ImGui_ImplOpenGL3_Data* bd, ImDrawData* draw_data)
+{
+    int vtx_count = 0, idx_count = 0;
+    for (const ImDrawList* draw_list : draw_data->CmdLists)
+    {
+        vtx_count += draw_list->VtxBuffer.Size;
+        idx_count += draw_list->IdxBuffer.Size;
+    }
+
+    if (vtx_count > bd->StreamVtxCapacity || idx_count > bd->StreamIdxCapacity)
+    {
+        int vtx_capacity = bd->StreamVtxCapacity > 0 ? bd->StreamVtxCapacity : IMGUI_IMPL_OPENGL_STREAM_MIN_VERTICES;
+        while (vtx_capacity < vtx_count || vtx_capacity * 3 < idx_count)
+            vtx_capacity *= 2;
+        if (!ImGui_ImplOpenGL3_CreateStreamBuffers(bd, vtx_capacity, vtx_capacity * 3))
+            return false;
+    }
+    else if (bd->StreamVtxUsed + vtx_count > bd->StreamVtxCapacity || bd->StreamIdxUsed + idx_count > bd->StreamIdxCapacity)
+    {
+        ImGui_ImplOpenGL3_AdvanceStreamSegment(bd);
+    }
+
+    bd->StreamVtxBase.resize(draw_data->CmdListsCount);
+    bd->StreamIdxBase.resize(draw_data->CmdListsCount);
+    const int vtx_segment = bd->StreamSegment * bd->StreamVtxCapacity;
+    const int idx_segment = bd->StreamSegment * bd->StreamIdxCapacity;
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* draw_list = draw_data->CmdLists[n];
+        const int vtx_first = vtx_segment + bd->StreamVtxUsed;
+        const int idx_first = idx_segment + bd->StreamIdxUsed;
+        if (draw_list->VtxBuffer.Size > 0)
+            memcpy(bd->StreamVtxMapped + (size_t)vtx_first * sizeof(ImDrawVert), draw_list->VtxBuffer.Data, (size_t)draw_list->VtxBuffer.Size * sizeof(ImDrawVert));
+        if (draw_list->IdxBuffer.Size > 0)
+            memcpy(bd->StreamIdxMapped + (size_t)idx_first * sizeof(ImDrawIdx), draw_list->IdxBuffer.Data, (size_t)draw_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        bd->StreamVtxBase[n] = (GLint)vtx_first;
+        bd->StreamIdxBase[n] = (GLintptr)idx_first * (GLintptr)sizeof(ImDrawIdx);
+        bd->StreamVtxUsed += draw_list->VtxBuffer.Size;
+        bd->StreamIdxUsed += draw_list->IdxBuffer.Size;
+    }
+    return true;
+}
+#endif
+
+bool    ImGui_ImplOpenGL3_SetStreamingUploads(bool enable)
+{
+    ImGui_ImplOpenGL3_Data* bd = ImGui_ImplOpenGL3_GetBackendData();
+    IM_ASSERT(bd != nullptr && "Context or backend not initialized! Did you call ImGui_ImplOpenGL3_Init()?");
+    bd->UseStreamingUploads = enable && bd->HasBufferStorage;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+    if (!bd->UseStreamingUploads)
+        ImGui_ImplOpenGL3_DestroyStreamBuffers(bd);
+#endif
+    return bd->UseStreamingUploads;
+}
+
+void    ImGui_ImplOpenGL3_GetUploadStats(ImGui_ImplOpenGL3_UploadStats* out_stats, bool reset)
+{
+    ImGui_ImplOpenGL3_Data* bd = ImGui_ImplOpenGL3_GetBackendData();
+    IM_ASSERT(bd != nullptr && "Context or backend not initialized! Did you call ImGui_ImplOpenGL3_Init()?");
+    *out_stats = bd->Stats;
+    if (reset)
+        memset((void*)&bd->Stats, 0, sizeof(bd->Stats));
+}
+
 void    ImGui_ImplOpenGL3_NewFrame()
 {
     ImGui_ImplOpenGL3_Data* bd = ImGui_ImplOpenGL3_GetBackendData();
@@ -424,6 +595,13 @@ void    ImGui_ImplOpenGL3_NewFrame()
         ImGui_ImplOpenGL3_CreateDeviceObjects();
     if (!bd->FontTexture)
         ImGui_ImplOpenGL3_CreateFontsTexture();
+
+    bd->Stats.Frames++;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+    // Each frame gets a fresh segment, the GPU can still be reading the last two
+    if (bd->StreamVboHandle != 0 && (bd->StreamVtxUsed > 0 || bd->StreamIdxUsed > 0))
+        ImGui_ImplOpenGL3_AdvanceStreamSegment(bd);
+#endif
 }
 
 static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData* draw_data, int fb_width, int fb_height, GLuint vertex_array_object)
@@ -490,8 +668,8 @@ static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData* draw_data, int fb_wid
 #endif
 
     // Bind vertex/index buffers and setup attributes for ImDrawVert
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, bd->VboHandle));
-    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bd->ElementsHandle));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, bd->StreamVboHandle ? bd->StreamVboHandle : bd->VboHandle));
+    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bd->StreamVboHandle ? bd->StreamElementsHandle : bd->ElementsHandle));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxPos));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxUV));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxColor));
@@ -560,6 +738,12 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     GLuint vertex_array_object = 0;
 #ifdef IMGUI_IMPL_OPENGL_USE_VERTEX_ARRAY
     GL_CALL(glGenVertexArrays(1, &vertex_array_object));
+#endif
+    // Streamed data goes in up front, buffers may be recreated and the attributes have to point at the new ones
+    bool streaming = false;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+    if (bd->UseStreamingUploads)
+        streaming = ImGui_ImplOpenGL3_StreamDrawData(bd, draw_data);
 #endif
     ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object);
 
@@ -580,19 +764,31 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
         // - We are now back to using exclusively glBufferData(). So bd->UseBufferSubData IS ALWAYS FALSE in this code.
         //   We are keeping the old code path for a while in case people finding new issues may want to test the bd->UseBufferSubData path.
         // - See https://github.com/ocornut/imgui/issues/4468 and please report any corruption issues.
+        // - [ssedit] With streaming uploads everything is already in the mapped ring, draws just offset into it.
         const GLsizeiptr vtx_buffer_size = (GLsizeiptr)draw_list->VtxBuffer.Size * (int)sizeof(ImDrawVert);
         const GLsizeiptr idx_buffer_size = (GLsizeiptr)draw_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx);
-        if (bd->UseBufferSubData)
+        GLint vtx_base = 0;
+        GLintptr idx_base = 0;
+        if (streaming)
+        {
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+            vtx_base = bd->StreamVtxBase[n];
+            idx_base = bd->StreamIdxBase[n];
+#endif
+        }
+        else if (bd->UseBufferSubData)
         {
             if (bd->VertexBufferSize < vtx_buffer_size)
             {
                 bd->VertexBufferSize = vtx_buffer_size;
                 GL_CALL(glBufferData(GL_ARRAY_BUFFER, bd->VertexBufferSize, nullptr, GL_STREAM_DRAW));
+                bd->Stats.Respecifications++;
             }
             if (bd->IndexBufferSize < idx_buffer_size)
             {
                 bd->IndexBufferSize = idx_buffer_size;
                 GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, bd->IndexBufferSize, nullptr, GL_STREAM_DRAW));
+                bd->Stats.Respecifications++;
             }
             GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, vtx_buffer_size, (const GLvoid*)draw_list->VtxBuffer.Data));
             GL_CALL(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, idx_buffer_size, (const GLvoid*)draw_list->IdxBuffer.Data));
@@ -601,6 +797,7 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
         {
             GL_CALL(glBufferData(GL_ARRAY_BUFFER, vtx_buffer_size, (const GLvoid*)draw_list->VtxBuffer.Data, GL_STREAM_DRAW));
             GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_buffer_size, (const GLvoid*)draw_list->IdxBuffer.Data, GL_STREAM_DRAW));
+            bd->Stats.Respecifications += 2;
         }
 
         for (int cmd_i = 0; cmd_i < draw_list->CmdBuffer.Size; cmd_i++)
@@ -630,7 +827,7 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
                 GL_CALL(glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->GetTexID()));
 #ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
                 if (bd->GlVersion >= 320)
-                    GL_CALL(glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)), (GLint)pcmd->VtxOffset));
+                    GL_CALL(glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(idx_base + pcmd->IdxOffset * sizeof(ImDrawIdx)), vtx_base + (GLint)pcmd->VtxOffset));
                 else
 #endif
                 GL_CALL(glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx))));
@@ -969,6 +1166,9 @@ void    ImGui_ImplOpenGL3_DestroyDeviceObjects()
     ImGui_ImplOpenGL3_Data* bd = ImGui_ImplOpenGL3_GetBackendData();
     if (bd->VboHandle)      { glDeleteBuffers(1, &bd->VboHandle); bd->VboHandle = 0; }
     if (bd->ElementsHandle) { glDeleteBuffers(1, &bd->ElementsHandle); bd->ElementsHandle = 0; }
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_BUFFER_STORAGE
+    ImGui_ImplOpenGL3_DestroyStreamBuffers(bd);
+#endif
     if (bd->ShaderHandle)   { glDeleteProgram(bd->ShaderHandle); bd->ShaderHandle = 0; }
     ImGui_ImplOpenGL3_DestroyFontsTexture();
 }
@@ -41,6 +41,20 @@ IMGUI_IMPL_API void     ImGui_ImplOpenGL3_DestroyFontsTexture();
 IMGUI_IMPL_API bool     ImGui_ImplOpenGL3_CreateDeviceObjects();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_DestroyDeviceObjects();
 
+// (Optional, ssedit) Streaming uploads through a persistently mapped ring buffer instead of
+// re-specifying the vertex/index buffers for every draw list. Needs GL 4.4 or ARB_buffer_storage,
+// returns false (and keeps using glBufferData) when the context doesn't have it.
+IMGUI_IMPL_API bool     ImGui_ImplOpenGL3_SetStreamingUploads(bool enable);
+
+// (Optional, ssedit) Counts of upload operations that can make the driver stall, since the last reset
+struct ImGui_ImplOpenGL3_UploadStats
+{
+    int     Frames;             // ImGui_ImplOpenGL3_NewFrame() calls
+    int     Respecifications;   // glBufferData() calls on vertex/index buffers, each may sync or allocate
+    int     FenceWaits;         // Ring segments that were still in use by the GPU when they came around again
+};
+IMGUI_IMPL_API void     ImGui_ImplOpenGL3_GetUploadStats(ImGui_ImplOpenGL3_UploadStats* out_stats, bool reset);
+
 // Configuration flags to add in your imconfig file:
 //#define IMGUI_IMPL_OPENGL_ES2     // Enable ES 2 (Auto-detected on Emscripten)
 //#define IMGUI_IMPL_OPENGL_ES3     // Enable ES 3 (Auto-detected on iOS/Android)
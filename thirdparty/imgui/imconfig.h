@@ -139,3 +139,9 @@ namespace ImGui
     void MyFunction(const char* name, MyMatrix44* mtx);
 }
 */
+
+//---- ssedit: each thread has its own current context. Thread pool workers tessellating shapes
+// never have one, so ImGui's debug allocation hook doesn't touch the UI thread's context from them.
+struct ImGuiContext;
+inline thread_local ImGuiContext* SseditImGuiContext = nullptr;
+#define GImGui SseditImGuiContext